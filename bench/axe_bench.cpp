@@ -0,0 +1,868 @@
+/*	axe-bench
+	Benchmarks for the map core. Everything runs on memory bitmaps, so no
+	display is needed. Drawing cases use a display when one can be created,
+	otherwise they draw into a memory bitmap.
+
+	Usage: axe-bench <case> [args]
+		import [image]		Decode, level and slice an image on the worker pool (synthetic 8192x8192 if no image)
+		fog [tiles]		Draw fog over a tiles x tiles view (default 200) with the mask and per-tile paths
+		mdf [tiles]		Save and load a tiles x tiles map (default 4000) as MDF 0x0100 and 0x0200, mapped and streamed
+		bundle [image]		Open a map from a campaign bundle, decoding the embedded source vs mapping the embedded pyramid
+		viewer [image]		Get the viewer's image ready, loading it from disk vs uploading from the editor's decode
+		input [events]		Dispatch a synthetic flood of events (default 10000), binding table vs the old per-key maps
+		suite [tiles] [json] [thresholds]
+					Time the map core on synthetic maps from 100x100 up to tiles x tiles (default 10000),
+					write the results to json and fail when one is over its threshold
+*/
+
+#include <iostream>
+#include <string>
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <iomanip> // std::setw
+#include <algorithm> // std::max
+#include <map>
+#include <functional>
+#include <cstring> // memset
+#include <sstream>
+#include <memory_resource>
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#include <allegro5/allegro_primitives.h>
+
+#include <chrono>
+
+#include "image_cache.hpp"
+#include "image_import.hpp"
+#include "thread_pool.hpp"
+#include "map.hpp"
+#include "mdf.hpp"
+#include "bundle.hpp"
+#include "input.hpp"
+#include "edit_commands.hpp"
+
+using std_clk = std::chrono::steady_clock;
+namespace fs = std::filesystem;
+
+constexpr int BENCH_RUNS = 3;
+constexpr int SYNTHETIC_IMAGE_SIZE = 8192;
+constexpr int FOG_FRAMES = 200;
+constexpr int FOG_TILE_SIZE = 32;
+constexpr int FOG_TARGET_SIZE = 1024;
+constexpr int MDF_REVEALED_AREAS = 40;
+constexpr int INPUT_FLOOD_PASSES = 100;
+constexpr int SUITE_SIZES[] = {100, 1000, 2500, 5000, 10000};
+constexpr int SUITE_IMAGE_SIZE = 1024;
+constexpr int SUITE_SET_TILES = 1000000;
+constexpr int SUITE_SAVE_EDITS = 100;
+
+static std::string makeSyntheticImage(int size)
+{
+	std::string path = (std::filesystem::temp_directory_path() / "axe-bench-map.png").string();
+	if (std::filesystem::exists(path)) return path;
+
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	ALLEGRO_BITMAP* bmp = al_create_bitmap(size, size);
+	ALLEGRO_LOCKED_REGION* lr = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+
+	// Smooth gradients with some noise, so it compresses roughly like a painted map
+	std::mt19937 rng(42);
+	for (int y = 0; y < size; ++y)
+	{
+		uint8_t* row = static_cast<uint8_t*>(lr->data) + static_cast<ptrdiff_t>(y) * lr->pitch;
+		for (int x = 0; x < size; ++x)
+		{
+			uint8_t noise = rng() & 15;
+			row[x * 4 + 0] = static_cast<uint8_t>((x >> 5) + noise);
+			row[x * 4 + 1] = static_cast<uint8_t>((y >> 5) + noise);
+			row[x * 4 + 2] = static_cast<uint8_t>(((x + y) >> 6) + noise);
+			row[x * 4 + 3] = 255;
+		}
+	}
+
+	al_unlock_bitmap(bmp);
+	al_save_bitmap(path.c_str(), bmp);
+	al_destroy_bitmap(bmp);
+
+	return path;
+}
+
+static int benchImport(int argc, char** argv)
+{
+	std::string path = argc > 2 ? argv[2] : makeSyntheticImage(SYNTHETIC_IMAGE_SIZE);
+
+	// Measure the decode path, not the image cache
+	setImageCacheDir("");
+
+	ImportStats best;
+	for (int run = 0; run < BENCH_RUNS; ++run)
+	{
+		ImageImport import(path, MAP_IMAGE_PAGE_SIZE);
+
+		while (!import.isReadyForUpload() && !import.isFinished()) al_rest(0.001);
+
+		if (import.getStage() != IMPORT_UPLOAD)
+		{
+			std::cerr << "Import failed: " << path << std::endl;
+			return 1;
+		}
+
+		ImportStats stats = import.getStats();
+		if (run == 0 || stats.cpuTime() < best.cpuTime()) best = stats;
+	}
+
+	std::cout << "import " << path << "\n"
+		<< "  threads:    " << getWorkerPool().size() << " + caller\n"
+		<< "  source:     " << best.source_bytes / (1024.0 * 1024.0) << " MB\n"
+		<< "  decode:     " << best.decode_time << " s\n"
+		<< "  levels:     " << best.levels_time << " s\n"
+		<< "  slice:      " << best.slice_time << " s\n"
+		<< "  throughput: " << best.throughput() << " MB/s" << std::endl;
+
+	return 0;
+}
+
+// Average ms per frame drawing the fog of m over the whole view, optionally editing one tile per frame
+static double timeFogFrames(Map& m, const View::ViewPort& v, ALLEGRO_DISPLAY* display, bool edit)
+{
+	std::mt19937 rng(7);
+
+	drawMap(m, v, false, true); // Warm up, builds the fog mask
+	if (display) al_flip_display();
+
+	auto start = std_clk::now();
+	for (int frame = 0; frame < FOG_FRAMES; ++frame)
+	{
+		if (edit)
+		{
+			vec2i p(rng() % m.width, rng() % m.height);
+			setTile(m, p, !isTileShown(m, p));
+		}
+
+		al_clear_to_color(al_map_rgb(0, 0, 0));
+		drawMap(m, v, false, true);
+
+		if (display) al_flip_display();
+	}
+
+	// Make sure the GPU is done before stopping the clock
+	al_lock_bitmap(al_get_target_bitmap(), ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+	al_unlock_bitmap(al_get_target_bitmap());
+
+	return std::chrono::duration<double, std::milli>(std_clk::now() - start).count() / FOG_FRAMES;
+}
+
+static int benchFog(int argc, char** argv)
+{
+	int tiles = argc > 2 ? std::max(1, std::stoi(argv[2])) : 200;
+
+	al_init_primitives_addon();
+
+	al_set_new_display_flags(ALLEGRO_WINDOWED);
+	ALLEGRO_DISPLAY* display = al_create_display(FOG_TARGET_SIZE, FOG_TARGET_SIZE);
+	ALLEGRO_BITMAP* target = nullptr;
+
+	if (!display)
+	{
+		al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+		target = al_create_bitmap(FOG_TARGET_SIZE, FOG_TARGET_SIZE);
+		al_set_target_bitmap(target);
+	}
+
+	// Checkerboard, the worst case for the per-tile path since every run is one tile long
+	Map m;
+	m.tile_size = FOG_TILE_SIZE;
+	m.width = tiles;
+	m.height = tiles;
+
+	TileBitset fog;
+	fog.assign(tiles, tiles, false);
+	for (int y = 0; y < tiles; ++y)
+		for (int x = (y & 1); x < tiles; x += 2) fog.set(x, y, true);
+	replaceTiles(m, fog);
+
+	View::ViewPort v;
+	v.screen_pos = {0, 0};
+	v.size = {FOG_TARGET_SIZE, FOG_TARGET_SIZE};
+	v.scale = static_cast<double>(FOG_TARGET_SIZE) / (tiles * FOG_TILE_SIZE);
+	v.world_pos = vec2d(tiles * FOG_TILE_SIZE / 2.0, tiles * FOG_TILE_SIZE / 2.0);
+
+	// Time the composition itself, not blits of the retained frame
+	setMapRenderCache(false);
+
+	std::cout << "fog " << tiles << "x" << tiles << " tiles, " << (display ? "display" : "memory bitmap") << "\n";
+
+	const MAP_RENDER_MODE modes[] = {RENDER_TILES, RENDER_FOG_MASK};
+	const char* names[] = {"tiles:", "fog mask:"};
+
+	for (int i = 0; i < 2; ++i)
+	{
+		setMapRenderMode(modes[i]);
+		double still = timeFogFrames(m, v, display, false);
+		double editing = timeFogFrames(m, v, display, true);
+
+		std::cout << "  " << std::left << std::setw(11) << names[i] << still << " ms/frame, " << editing << " ms/frame editing" << std::endl;
+	}
+
+	destroyMap(m);
+	if (target) al_destroy_bitmap(target);
+	if (display) al_destroy_display(display);
+
+	return 0;
+}
+
+// The 0x0100 layout, only kept here to compare against
+static bool writeMapFileV1(const std::string& file, const MapFileInfo& info, const TileBitset& tiles)
+{
+	std::ofstream out(file, std::ofstream::out | std::ofstream::binary);
+	if (!out.is_open()) return false;
+
+	const char magic[3] = {'M', 'D', 'F'};
+	uint16_t version = MDF_VERSION_1;
+	size_t path_sz = info.image_path.size();
+
+	out.write(magic, 3);
+	out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	out.write(reinterpret_cast<const char*>(&info.view_pos), sizeof(info.view_pos));
+	out.write(reinterpret_cast<const char*>(&info.view_scale), sizeof(info.view_scale));
+	out.write(reinterpret_cast<const char*>(&path_sz), sizeof(path_sz));
+	out.write(info.image_path.data(), path_sz);
+	out.write(reinterpret_cast<const char*>(&info.width), sizeof(info.width));
+	out.write(reinterpret_cast<const char*>(&info.height), sizeof(info.height));
+	out.write(reinterpret_cast<const char*>(&info.tile_size), sizeof(info.tile_size));
+
+	std::vector<char> row_buf(info.width);
+	for (int y = 0; y < info.height; ++y)
+	{
+		for (int x = 0; x < info.width; ++x) row_buf[x] = tiles.test(x, y);
+		out.write(row_buf.data(), row_buf.size());
+	}
+
+	return static_cast<bool>(out);
+}
+
+// Reads the whole file through a stream before parsing, what loadMap did before the file was mapped
+static bool readMapFileStream(const std::string& file, MapFileInfo& info, TileBitset& tiles)
+{
+	std::ifstream in(file, std::ifstream::binary);
+	if (!in.is_open()) return false;
+
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	return readMapData(bytes.data(), bytes.size(), info, tiles);
+}
+
+// Best of BENCH_RUNS in ms
+template<typename F>
+static double timeBest(F f)
+{
+	double best = 0.0;
+	for (int run = 0; run < BENCH_RUNS; ++run)
+	{
+		auto start = std_clk::now();
+		if (!f()) return -1.0;
+		double t = std::chrono::duration<double, std::milli>(std_clk::now() - start).count();
+		if (run == 0 || t < best) best = t;
+	}
+	return best;
+}
+
+// A few explored areas with ragged edges, roughly what a campaign map looks like
+static TileBitset makeSyntheticFog(int tiles)
+{
+	TileBitset fog(tiles, tiles, false);
+	std::mt19937 rng(11);
+	for (int i = 0; i < MDF_REVEALED_AREAS; ++i)
+	{
+		vec2i tl(rng() % tiles, rng() % tiles);
+		vec2i size(1 + rng() % std::max(1, tiles / 8), 1 + rng() % std::max(1, tiles / 8));
+		fog.setRect(tl, tl + size, true);
+	}
+	for (int i = 0; i < tiles * 4; ++i) fog.set(rng() % tiles, rng() % tiles, rng() & 1);
+
+	return fog;
+}
+
+static int benchMdf(int argc, char** argv)
+{
+	int tiles = argc > 2 ? std::max(1, std::stoi(argv[2])) : 4000;
+
+	MapFileInfo info;
+	info.image_path = "bench/map.png";
+	info.width = tiles;
+	info.height = tiles;
+	info.tile_size = 32;
+
+	TileBitset fog = makeSyntheticFog(tiles);
+
+	fs::path dir = fs::temp_directory_path();
+	const std::string files[] = {(dir / "axe-bench-v1.mdf").string(), (dir / "axe-bench-v2.mdf").string()};
+	const char* names[] = {"0x0100:", "0x0200:"};
+
+	std::cout << "mdf " << tiles << "x" << tiles << " tiles, " << fog.count() << " shown\n";
+
+	for (int i = 0; i < 2; ++i)
+	{
+		double save = timeBest([&]() { return i == 0 ? writeMapFileV1(files[i], info, fog) : writeMapFile(files[i], info, fog); });
+
+		MapFileInfo loaded_info;
+		TileBitset loaded;
+		double load = timeBest([&]() { return readMapFile(files[i], loaded_info, loaded); });
+		bool mapped_ok = loaded == fog;
+		double stream_load = timeBest([&]() { return readMapFileStream(files[i], loaded_info, loaded); });
+
+		if (save < 0.0 || load < 0.0 || stream_load < 0.0 || !mapped_ok || loaded != fog)
+		{
+			std::cerr << "Round trip failed: " << files[i] << std::endl;
+			return 1;
+		}
+
+		std::cout << "  " << std::left << std::setw(8) << names[i] << std::setw(10) << fs::file_size(files[i]) / 1024.0 << " KB, save "
+			<< save << " ms, load " << load << " ms mapped, " << stream_load << " ms streamed" << std::endl;
+
+		fs::remove(files[i]);
+	}
+
+	return 0;
+}
+
+static int benchBundle(int argc, char** argv)
+{
+	std::string path = argc > 2 ? argv[2] : makeSyntheticImage(SYNTHETIC_IMAGE_SIZE);
+	std::string bundle = (fs::temp_directory_path() / "axe-bench.axb").string();
+
+	MapFileInfo info;
+	info.image_path = path;
+	info.tile_size = 32;
+
+	std::cout << "bundle " << path << "\n";
+
+	const bool decoded[] = {false, true};
+	const char* names[] = {"source:", "decoded:"};
+
+	for (int i = 0; i < 2; ++i)
+	{
+		// Sized from the decoded image so the map fits it, as createMap would
+		DecodedImage probe;
+		if (!loadDecodedImage(probe, path)) return 1;
+		info.width = probe.levels[0].width / info.tile_size;
+		info.height = probe.levels[0].height / info.tile_size;
+
+		std::error_code ec;
+		fs::remove(bundle, ec);
+		if (!writeBundleMap(bundle, "bench", info, TileBitset(info.width, info.height), decoded[i])) return 1;
+
+		double open = timeBest([&]()
+		{
+			Bundle b;
+			MapFileInfo loaded_info;
+			TileBitset tiles;
+			DecodedImage img;
+			return openBundle(b, bundle) && readBundleMap(b, "bench", loaded_info, tiles) && loadDecodedImage(img, loaded_info.image_path);
+		});
+
+		if (open < 0.0)
+		{
+			std::cerr << "Failed to open map from bundle: " << bundle << std::endl;
+			return 1;
+		}
+
+		std::cout << "  " << std::left << std::setw(10) << names[i] << std::setw(10) << fs::file_size(bundle) / (1024.0 * 1024.0) << " MB, open "
+			<< open << " ms" << std::endl;
+
+		fs::remove(bundle, ec);
+	}
+
+	return 0;
+}
+
+// What the viewer does between F1 and its first frame: it used to load the image itself,
+// now it uploads pages from the decode the editor already holds
+static int benchViewer(int argc, char** argv)
+{
+	std::string path = argc > 2 ? argv[2] : makeSyntheticImage(SYNTHETIC_IMAGE_SIZE);
+	std::string cache_dir = getImageCacheDir();
+
+	auto loadFromDisk = [&]()
+	{
+		MapImage img;
+		bool ok = loadMapImage(img, path);
+		destroyMapImage(img);
+		return ok;
+	};
+
+	setImageCacheDir("");
+	double decode = timeBest(loadFromDisk);
+
+	setImageCacheDir(cache_dir);
+	loadFromDisk(); // Makes sure the cache has it
+	double cached = timeBest(loadFromDisk);
+
+	auto shared = std::make_shared<DecodedImage>();
+	if (!loadDecodedImage(*shared, path)) return 1;
+
+	double upload = timeBest([&]()
+	{
+		MapImage img;
+		bool ok = uploadMapImage(img, shared);
+		destroyMapImage(img);
+		return ok;
+	});
+
+	if (decode < 0.0 || cached < 0.0 || upload < 0.0)
+	{
+		std::cerr << "Failed to load image: " << path << std::endl;
+		return 1;
+	}
+
+	std::cout << "viewer " << path << "\n"
+		<< "  decode from disk: " << decode << " ms\n"
+		<< "  image cache:      " << cached << " ms\n"
+		<< "  shared decode:    " << upload << " ms" << std::endl;
+
+	return 0;
+}
+
+// The input handler before bindings were table driven, every event clears the edge arrays
+// and looks its key up in the press and release maps
+struct LegacyInput
+{
+	int modifiers = 0;
+	vec2i mouse_position;
+	bool keys_pressed[CUSTOM_ALLEGRO_KEY_MAX];
+	bool keys_held[CUSTOM_ALLEGRO_KEY_MAX];
+	bool keys_released[CUSTOM_ALLEGRO_KEY_MAX];
+	std::map<int, std::function<void(void)> > keybinds_r;
+	std::map<int, std::function<void(void)> > keybinds_p;
+
+	void callKeybind(int key, bool pressed)
+	{
+		if (pressed && keybinds_p.find(key) != keybinds_p.end())
+		{
+			keybinds_p[key]();
+			return;
+		}
+
+		if (keybinds_r.find(key) != keybinds_r.end()) keybinds_r[key]();
+	}
+
+	void getInput(const ALLEGRO_EVENT& ev)
+	{
+		memset(keys_pressed, false, sizeof(keys_pressed));
+		memset(keys_released, false, sizeof(keys_released));
+
+		switch (ev.type)
+		{
+			case ALLEGRO_EVENT_MOUSE_AXES:
+				if (ev.mouse.dz > 0) callKeybind(MOUSE::WHEELUP, true);
+				else if (ev.mouse.dz < 0) callKeybind(MOUSE::WHEELDOWN, true);
+				mouse_position = { ev.mouse.x, ev.mouse.y };
+			break;
+
+			case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+				callKeybind(ALLEGRO_KEY_MAX + ev.mouse.button, true);
+				keys_pressed[ALLEGRO_KEY_MAX + ev.mouse.button] = keys_held[ALLEGRO_KEY_MAX + ev.mouse.button] = true;
+			break;
+
+			case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+				callKeybind(ALLEGRO_KEY_MAX + ev.mouse.button, false);
+				keys_released[ALLEGRO_KEY_MAX + ev.mouse.button] = true;
+				keys_held[ALLEGRO_KEY_MAX + ev.mouse.button] = false;
+			break;
+
+			case ALLEGRO_EVENT_KEY_DOWN:
+				modifiers = ev.keyboard.modifiers;
+				callKeybind(ev.keyboard.keycode, true);
+				keys_pressed[ev.keyboard.keycode] = keys_held[ev.keyboard.keycode] = true;
+			break;
+
+			case ALLEGRO_EVENT_KEY_UP:
+				modifiers = ev.keyboard.modifiers;
+				callKeybind(ev.keyboard.keycode, false);
+				keys_released[ev.keyboard.keycode] = true;
+				keys_held[ev.keyboard.keycode] = false;
+			break;
+
+			default:
+			break;
+		}
+	}
+};
+
+static int benchInput(int argc, char** argv)
+{
+	int events = argc > 2 ? std::max(1, std::stoi(argv[2])) : 10000;
+
+	// Mostly mouse movement, like dragging a brush over the map, with wheel notches,
+	// button strokes and key taps mixed in. Every down is followed by its up.
+	const int keys[] = { ALLEGRO_KEY_Z, ALLEGRO_KEY_Y, ALLEGRO_KEY_G, ALLEGRO_KEY_R, ALLEGRO_KEY_SPACE, ALLEGRO_KEY_A, ALLEGRO_KEY_UP };
+	std::vector<ALLEGRO_EVENT> flood(events);
+	std::mt19937 rng(5);
+	for (int i = 0; i < events; ++i)
+	{
+		ALLEGRO_EVENT& ev = flood[i];
+		memset(&ev, 0, sizeof(ev));
+
+		int kind = rng() % 100;
+		if (i + 1 < events && kind < 10)
+		{
+			ev.type = ALLEGRO_EVENT_KEY_DOWN;
+			ev.keyboard.keycode = keys[rng() % (sizeof(keys) / sizeof(keys[0]))];
+			ev.keyboard.modifiers = rng() % 4 == 0 ? ALLEGRO_KEYMOD_CTRL : 0;
+			flood[++i] = ev;
+			flood[i].type = ALLEGRO_EVENT_KEY_UP;
+		}
+		else if (i + 1 < events && kind < 20)
+		{
+			ev.type = ALLEGRO_EVENT_MOUSE_BUTTON_DOWN;
+			ev.mouse.button = 1 + rng() % 3;
+			flood[++i] = ev;
+			flood[i].type = ALLEGRO_EVENT_MOUSE_BUTTON_UP;
+		}
+		else
+		{
+			ev.type = ALLEGRO_EVENT_MOUSE_AXES;
+			ev.mouse.x = rng() % 1920;
+			ev.mouse.y = rng() % 1080;
+			ev.mouse.dz = kind < 25 ? (rng() & 1 ? 1 : -1) : 0;
+		}
+	}
+
+	// The editor's bindings, each bumping a counter so the work per call is the same
+	const char* bindings =
+		"undo = ctrl+z\n" "redo = ctrl+y\n" "toggle_grid = g\n" "toggle_viewer_grid = ctrl+g\n" "reset_zoom = r\n"
+		"toggle_hidden = space\n" "viewer_zoom_in = up\n" "zoom_in = wheel_up\n" "zoom_out = wheel_down\n"
+		"pan = mouse_middle\n" "move_viewer = ctrl+mouse_middle\n" "reveal = mouse_left\n" "hide = mouse_right\n";
+
+	uint64_t calls = 0;
+	auto count = [&calls]() { ++calls; };
+
+	InputHandler table;
+	table.loadBindings(bindings, "bench bindings");
+	for (const char* action : { "undo", "redo", "toggle_grid", "toggle_viewer_grid", "reset_zoom", "toggle_hidden",
+								"viewer_zoom_in", "zoom_in", "zoom_out", "move_viewer" })
+	{
+		table.setAction(action, count);
+	}
+	for (const char* action : { "pan", "reveal", "hide" }) table.setAction(action, count, count);
+
+	// The old handler bound keys alone, the callbacks checked for Ctrl themselves
+	LegacyInput legacy;
+	for (int key : { (int)ALLEGRO_KEY_Z, (int)ALLEGRO_KEY_Y, (int)ALLEGRO_KEY_G, (int)ALLEGRO_KEY_R, (int)ALLEGRO_KEY_SPACE,
+					 (int)ALLEGRO_KEY_UP, (int)MOUSE::WHEELUP, (int)MOUSE::WHEELDOWN })
+	{
+		legacy.keybinds_p[key] = count;
+	}
+	for (int key : { (int)MOUSE::MIDDLE, (int)MOUSE::LEFT, (int)MOUSE::RIGHT })
+	{
+		legacy.keybinds_p[key] = count;
+		legacy.keybinds_r[key] = count;
+	}
+
+	std::cout << "input " << events << " events, " << INPUT_FLOOD_PASSES << " passes" << std::endl;
+
+	calls = 0;
+	double table_ms = timeBest([&]() {
+		for (int pass = 0; pass < INPUT_FLOOD_PASSES; ++pass)
+		{
+			for (const ALLEGRO_EVENT& ev : flood) table.getInput(ev);
+		}
+		return true;
+	});
+	uint64_t table_calls = calls / BENCH_RUNS / INPUT_FLOOD_PASSES;
+
+	calls = 0;
+	double legacy_ms = timeBest([&]() {
+		for (int pass = 0; pass < INPUT_FLOOD_PASSES; ++pass)
+		{
+			for (const ALLEGRO_EVENT& ev : flood) legacy.getInput(ev);
+		}
+		return true;
+	});
+	uint64_t legacy_calls = calls / BENCH_RUNS / INPUT_FLOOD_PASSES;
+
+	const double per_event = 1e6 / (static_cast<double>(events) * INPUT_FLOOD_PASSES);
+	std::cout << "  binding table: " << table_ms * per_event << " ns/event, " << table_calls << " callbacks per flood\n"
+		<< "  per-key maps:  " << legacy_ms * per_event << " ns/event, " << legacy_calls << " callbacks per flood" << std::endl;
+
+	return 0;
+}
+
+struct SuiteResult
+{
+	int tiles = 0;
+	std::vector<std::pair<std::string, double> > metrics; // Name with its unit, e.g. save_ms
+};
+
+// A gradient image decoded straight into memory, one small image serves every map size
+static std::shared_ptr<DecodedImage> makeSuiteImage()
+{
+	auto img = std::make_shared<DecodedImage>();
+	ImageLevel level;
+	level.width = SUITE_IMAGE_SIZE;
+	level.height = SUITE_IMAGE_SIZE;
+	level.pixels.resize(level.bytes());
+
+	for (int y = 0; y < level.height; ++y)
+	{
+		for (int x = 0; x < level.width; ++x)
+		{
+			uint8_t* p = &level.pixels[(static_cast<size_t>(y) * level.width + x) * 4];
+			p[0] = static_cast<uint8_t>(x >> 2);
+			p[1] = static_cast<uint8_t>(y >> 2);
+			p[2] = static_cast<uint8_t>((x + y) >> 3);
+			p[3] = 255;
+		}
+	}
+
+	img->levels.push_back(std::move(level));
+	buildImageLevels(*img);
+	return img;
+}
+
+// Best of BENCH_RUNS in ms, setup runs before each one outside the clock
+template<typename S, typename F>
+static double timeBest(S setup, F f)
+{
+	double best = 0.0;
+	for (int run = 0; run < BENCH_RUNS; ++run)
+	{
+		if (!setup()) return -1.0;
+
+		auto start = std_clk::now();
+		if (!f()) return -1.0;
+		double t = std::chrono::duration<double, std::milli>(std_clk::now() - start).count();
+		if (run == 0 || t < best) best = t;
+	}
+	return best;
+}
+
+static SuiteResult runSuiteSize(int tiles, std::shared_ptr<const DecodedImage> image, const std::string& file)
+{
+	SuiteResult r;
+	r.tiles = tiles;
+
+	const TileBitset fog = makeSyntheticFog(tiles);
+	MapFileInfo info;
+	info.image_path = "bench/map.png";
+	info.width = tiles;
+	info.height = tiles;
+	info.tile_size = FOG_TILE_SIZE;
+
+	// The whole map in view, the most fog there is to draw
+	View::ViewPort v;
+	v.screen_pos = {0, 0};
+	v.size = {FOG_TARGET_SIZE, FOG_TARGET_SIZE};
+	v.scale = static_cast<double>(FOG_TARGET_SIZE) / (tiles * FOG_TILE_SIZE);
+	v.world_pos = vec2d(tiles * FOG_TILE_SIZE / 2.0, tiles * FOG_TILE_SIZE / 2.0);
+
+	Map m;
+	MapImage img;
+	TileBitset tiles_in;
+	View::ViewPort lv = v;
+	r.metrics.emplace_back("create_ms", timeBest(
+		[&]() { destroyMap(m); tiles_in = fog; return uploadMapImage(img, image); },
+		[&]() { return createMap(m, img, "", info, tiles_in, lv); }));
+
+	r.metrics.emplace_back("draw_ms", timeFogFrames(m, v, nullptr, false));
+	r.metrics.emplace_back("draw_edit_ms", timeFogFrames(m, v, nullptr, true));
+
+	std::mt19937 rng(3);
+	auto start = std_clk::now();
+	for (int i = 0; i < SUITE_SET_TILES; ++i)
+	{
+		vec2i p(rng() % tiles, rng() % tiles);
+		setTile(m, p, !isTileShown(m, p));
+	}
+	r.metrics.emplace_back("set_tile_ns", std::chrono::duration<double, std::nano>(std_clk::now() - start).count() / SUITE_SET_TILES);
+
+	// A quarter of the map, a big Shift-drag
+	std::pmr::unsynchronized_pool_resource pool;
+	std::unique_ptr<Command> fill;
+	vec2i fill_tl(tiles / 4, tiles / 4), fill_br(tiles * 3 / 4, tiles * 3 / 4);
+	r.metrics.emplace_back("fill_ms", timeBest(
+		[&]() { if (fill) fill->undo(); fill.reset(); return true; },
+		[&]() { fill = std::make_unique<FillTileCommand>(m, true, fill_tl, fill_br, &pool); return true; }));
+	r.metrics.emplace_back("fill_undo_ms", timeBest(
+		[&]() { if (fill) fill->redo(); return fill != nullptr; },
+		[&]() { fill->undo(); return true; }));
+	fill.reset();
+
+	// Rewriting the whole file, then appending the blocks a few edits touched
+	r.metrics.emplace_back("save_ms", timeBest(
+		[&]() { m.saved_file.clear(); return true; },
+		[&]() { return saveMap(m, file, v); }));
+	r.metrics.emplace_back("save_edit_ms", timeBest(
+		[&]()
+		{
+			for (int i = 0; i < SUITE_SAVE_EDITS; ++i) setTile(m, vec2i(rng() % tiles, rng() % tiles), rng() & 1);
+			return true;
+		},
+		[&]() { return saveMap(m, file, v); }));
+
+	const TileBitset saved = m.v_tiles;
+	r.metrics.emplace_back("load_ms", timeBest([&]() { return loadMap(m, file, lv); }));
+
+	if (m.v_tiles != saved)
+	{
+		std::cerr << "Round trip failed: " << file << std::endl;
+		r.metrics.back().second = -1.0;
+	}
+
+	destroyMap(m);
+	fs::remove(file);
+
+	return r;
+}
+
+static bool writeSuiteJson(const std::string& file, const std::vector<SuiteResult>& results)
+{
+	std::ofstream out(file);
+	if (!out.is_open()) return false;
+
+	out << "{\n\t\"suite\": \"map\",\n\t\"tile_size\": " << FOG_TILE_SIZE << ",\n\t\"target_size\": " << FOG_TARGET_SIZE
+		<< ",\n\t\"runs\": " << BENCH_RUNS << ",\n\t\"results\": [";
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		out << (i ? ",\n" : "\n") << "\t\t{ \"tiles\": " << results[i].tiles;
+		for (const auto& metric : results[i].metrics) out << ", \"" << metric.first << "\": " << metric.second;
+		out << " }";
+	}
+
+	out << "\n\t]\n}\n";
+	return static_cast<bool>(out);
+}
+
+/*	Thresholds are one per line, the size, the metric and the most it may take:
+		# tiles metric = max
+		1000 save_ms = 50
+	Returns false when a result is over its threshold, or failed (negative).
+*/
+static bool checkSuiteThresholds(const std::string& file, const std::vector<SuiteResult>& results)
+{
+	std::ifstream in(file);
+	if (!in.is_open())
+	{
+		std::cerr << "Failed to open thresholds: " << file << std::endl;
+		return false;
+	}
+
+	bool ok = true;
+	std::string line;
+	for (int line_no = 1; std::getline(in, line); ++line_no)
+	{
+		line = line.substr(0, line.find('#'));
+		if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+		std::istringstream ss(line);
+		int tiles = 0;
+		std::string metric, eq;
+		double max = 0.0;
+		if (!(ss >> tiles >> metric >> eq >> max) || eq != "=")
+		{
+			std::cerr << file << ":" << line_no << ": expected <tiles> <metric> = <max>" << std::endl;
+			ok = false;
+			continue;
+		}
+
+		for (const SuiteResult& r : results)
+		{
+			if (r.tiles != tiles) continue;
+
+			for (const auto& m : r.metrics)
+			{
+				if (m.first != metric || (m.second >= 0.0 && m.second <= max)) continue;
+
+				std::cerr << tiles << "x" << tiles << " " << metric << ": " << m.second << " over " << max << std::endl;
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+static int benchSuite(int argc, char** argv)
+{
+	int max_tiles = argc > 2 ? std::max(1, std::stoi(argv[2])) : 10000;
+	std::string json = argc > 3 ? argv[3] : "";
+	std::string thresholds = argc > 4 ? argv[4] : "";
+
+	al_init_primitives_addon();
+
+	// Memory bitmaps only, so it runs the same on a headless box
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	ALLEGRO_BITMAP* target = al_create_bitmap(FOG_TARGET_SIZE, FOG_TARGET_SIZE);
+	if (!target) return 1;
+	al_set_target_bitmap(target);
+
+	// Composing every frame, the same as the fog case
+	setMapRenderCache(false);
+	setMapRenderMode(RENDER_FOG_MASK);
+
+	std::shared_ptr<const DecodedImage> image = makeSuiteImage();
+	const std::string file = (fs::temp_directory_path() / "axe-bench-suite.mdf").string();
+
+	std::vector<SuiteResult> results;
+	bool failed = false;
+	for (int tiles : SUITE_SIZES)
+	{
+		if (tiles > max_tiles) break;
+
+		results.push_back(runSuiteSize(tiles, image, file));
+
+		std::cout << "suite " << tiles << "x" << tiles << " tiles\n";
+		for (const auto& m : results.back().metrics)
+		{
+			std::cout << "  " << std::left << std::setw(14) << m.first << m.second << std::endl;
+			if (m.second < 0.0) failed = true;
+		}
+	}
+
+	al_set_target_bitmap(nullptr);
+	al_destroy_bitmap(target);
+
+	if (!json.empty() && !writeSuiteJson(json, results))
+	{
+		std::cerr << "Failed to write results: " << json << std::endl;
+		failed = true;
+	}
+
+	if (!thresholds.empty() && !checkSuiteThresholds(thresholds, results)) failed = true;
+
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (!al_init() || !al_init_image_addon())
+	{
+		std::cerr << "Failed to load Allegro!" << std::endl;
+		return 1;
+	}
+
+	std::string bench_case = argc > 1 ? argv[1] : "";
+
+	if (bench_case == "import") return benchImport(argc, argv);
+	if (bench_case == "fog") return benchFog(argc, argv);
+	if (bench_case == "mdf") return benchMdf(argc, argv);
+	if (bench_case == "bundle") return benchBundle(argc, argv);
+	if (bench_case == "viewer") return benchViewer(argc, argv);
+	if (bench_case == "input") return benchInput(argc, argv);
+	if (bench_case == "suite") return benchSuite(argc, argv);
+
+	std::cerr << "Usage: axe-bench <case> [args]\n"
+		<< "  import [image]    Image import pipeline throughput\n"
+		<< "  fog [tiles]       Fog drawing, mask vs per-tile\n"
+		<< "  mdf [tiles]       Map save and load, 0x0100 vs 0x0200\n"
+		<< "  bundle [image]    Opening a bundled map, embedded source vs pre-decoded\n"
+		<< "  viewer [image]    Viewer image load, from disk vs the editor's shared decode\n"
+		<< "  input [events]    Input dispatch, binding table vs per-key maps\n"
+		<< "  suite [tiles] [json] [thresholds]\n"
+		<< "                    Map core on 100x100 up to tiles x tiles maps, results to json, checked against thresholds\n";
+
+	return 1;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "map.hpp"
+#include "view.hpp"
+#include "tile_snapshot.hpp"
+
+constexpr int AUTOSAVE_DEFAULT_INTERVAL = 120;	// Seconds, 0 turns autosave off
+constexpr int AUTOSAVE_DEFAULT_GENERATIONS = 5;
+constexpr char AUTOSAVE_DIR[] = "autosave";
+
+struct AutosaveStats
+{
+	uint64_t saves = 0;
+	uint64_t skipped = 0;			// Previous write still running
+	uint64_t failures = 0;
+	double capture_time = 0.0;		// Seconds the calling thread spent on the last save() that wrote
+	double write_time = 0.0;		// Seconds the worker spent writing the last one
+	std::string last_file;
+};
+
+// Periodic saves that stay off the UI thread. save() takes a snapshot the
+// editor already has and a few fields, which is all the UI thread pays for, and
+// the snapshot is serialized on the worker pool into AUTOSAVE_DIR/autosave-<n>.mdf.
+// Only the newest generations are kept.
+class Autosaver
+{
+public:
+	explicit Autosaver(const std::string& dir = AUTOSAVE_DIR);
+
+	Autosaver(const Autosaver& other) = delete;
+	Autosaver& operator=(const Autosaver& other) = delete;
+
+	void setGenerations(int generations);
+	int getGenerations() const;
+
+	// Skips unchanged maps and returns false, also when the last write hasn't finished
+	bool save(const Map& m, std::shared_ptr<const TileSnapshot> tiles, const View::ViewPort& v);
+
+	AutosaveStats getStats() const;
+
+	struct State; // Shared with the worker task, which may outlive the Autosaver
+
+private:
+	std::shared_ptr<State> state;
+
+	// UI thread only, what the last snapshot was taken of
+	std::string saved_path;
+	std::shared_ptr<const TileSnapshot> saved_tiles;
+	vec2d saved_view_pos;
+	double saved_view_scale = 0.0;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "map_image.hpp"
+#include "mdf.hpp"
+#include "mapped_file.hpp"
+
+/*	Campaign bundles (.axb)
+
+	One file holding any number of maps and the images they use, so a campaign
+	can be moved between machines. Images are stored once per content hash,
+	as the source file, a pre-decoded RGBA8 pyramid, or both. Opening a bundle
+	only reads the table of contents, a map and its image are read when opened.
+
+	Version 0x0100, every field little-endian:
+		Header, 32 bytes
+			0	"AXB"
+			3	u16 version
+			5	u8[3] reserved
+			8	u64 offset of the table of contents
+			16	u64 size of the table of contents
+			24	u32 CRC-32 of the table of contents
+			28	u32 CRC-32 of bytes 0-27
+
+		Table of contents
+			u32 image count, then per image
+				u64 content hash (hashBytes of the source file)
+				u8 extension length, extension ("png", the source decoder)
+				u64 source offset, u64 source size (0 if not embedded)
+				u32 level count, then per level u32 width, u32 height, u64 offset
+			u32 map count, then per map
+				u16 name length, name
+				u64 image hash, u64 offset, u64 size of an MDF 0x0200 file
+
+	Level data is RGBA8 premultiplied, tightly packed and 4096 aligned, so it
+	can be used straight from the mapping like the image cache.
+*/
+
+constexpr uint16_t BUNDLE_VERSION = 0x0100;
+
+struct BundleLevel
+{
+	int width = 0;
+	int height = 0;
+	uint64_t offset = 0;
+};
+
+struct BundleImage
+{
+	uint64_t hash = 0;
+	std::string ext;
+	uint64_t source_offset = 0;
+	uint64_t source_size = 0;
+	std::vector<BundleLevel> levels; // Empty if not pre-decoded
+};
+
+struct BundleMap
+{
+	std::string name;
+	uint64_t image_hash = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+struct Bundle
+{
+	std::string path;
+	std::shared_ptr<MappedFile> file;
+	std::vector<BundleImage> images;
+	std::vector<BundleMap> maps;
+};
+
+bool openBundle(Bundle& b, const std::string& path); // Maps the file and reads the table of contents only
+void closeBundle(Bundle& b);
+const BundleImage* findBundleImage(const Bundle& b, uint64_t hash);
+const BundleMap* findBundleMap(const Bundle& b, const std::string& name);
+
+// info.image_path comes back as a bundle image path, which loadDecodedImage() understands
+bool readBundleMap(const Bundle& b, const std::string& name, MapFileInfo& info, TileBitset& tiles);
+
+// Adds the map to the bundle, replacing one with the same name, and creates the bundle if needed.
+// info.image_path can be an image file or a bundle image path. The image is only embedded if no
+// other map in the bundle uses the same content. With embed_decoded the pyramid is stored as well,
+// so opening the map needs no decoding.
+bool writeBundleMap(const std::string& path, const std::string& name, const MapFileInfo& info, const TileBitset& tiles, bool embed_decoded);
+
+// "<bundle>#axb:<hash>" names an image inside a bundle wherever an image path is expected
+std::string makeBundleImagePath(const std::string& bundle_path, uint64_t hash);
+bool isBundleImagePath(const std::string& path);
+bool parseBundleImagePath(const std::string& path, std::string& bundle_path, uint64_t& hash);
+
+// Maps the pre-decoded pyramid if there is one (has_levels), otherwise decodes the embedded source into level 0
+bool loadBundleImage(DecodedImage& img, const std::string& image_path, bool& has_levels);
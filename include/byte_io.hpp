@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // memcpy
+#include <vector>
+
+// Appends little-endian fields to a byte buffer
+struct ByteWriter
+{
+	std::vector<uint8_t> buf;
+	uint64_t base = 0; // File offset of buf[0], when appending to an existing file
+
+	size_t pos() const { return buf.size(); }
+
+	void u8(uint8_t v) { buf.push_back(v); }
+	void u16(uint16_t v) { for (int i = 0; i < 2; ++i) buf.push_back(static_cast<uint8_t>(v >> (8 * i))); }
+	void u32(uint32_t v) { for (int i = 0; i < 4; ++i) buf.push_back(static_cast<uint8_t>(v >> (8 * i))); }
+	void u64(uint64_t v) { for (int i = 0; i < 8; ++i) buf.push_back(static_cast<uint8_t>(v >> (8 * i))); }
+	void f64(double v) { uint64_t bits; memcpy(&bits, &v, sizeof(bits)); u64(bits); }
+	void bytes(const void* data, size_t size) { const uint8_t* p = static_cast<const uint8_t*>(data); buf.insert(buf.end(), p, p + size); }
+	void varint(uint64_t v)
+	{
+		while (v >= 0x80)
+		{
+			buf.push_back(static_cast<uint8_t>(v | 0x80));
+			v >>= 7;
+		}
+		buf.push_back(static_cast<uint8_t>(v));
+	}
+
+	void patchU32(size_t at, uint32_t v) { for (int i = 0; i < 4; ++i) buf[at + i] = static_cast<uint8_t>(v >> (8 * i)); }
+	void patchU64(size_t at, uint64_t v) { for (int i = 0; i < 8; ++i) buf[at + i] = static_cast<uint8_t>(v >> (8 * i)); }
+};
+
+// Reads little-endian fields from a byte range. Reading past the end sets ok to false
+// and returns zeros, so a parse can check ok once at the end of each structure.
+struct ByteReader
+{
+	const uint8_t* data;
+	size_t size;
+	size_t pos = 0;
+	bool ok = true;
+
+	ByteReader(const uint8_t* d, size_t s) : data(d), size(s) {}
+
+	bool has(size_t n)
+	{
+		if (ok && n <= size - pos) return true;
+		ok = false;
+		return false;
+	}
+
+	uint64_t uint(int n)
+	{
+		if (!has(n)) return 0;
+		uint64_t v = 0;
+		for (int i = 0; i < n; ++i) v |= static_cast<uint64_t>(data[pos + i]) << (8 * i);
+		pos += n;
+		return v;
+	}
+
+	uint8_t u8() { return static_cast<uint8_t>(uint(1)); }
+	uint16_t u16() { return static_cast<uint16_t>(uint(2)); }
+	uint32_t u32() { return static_cast<uint32_t>(uint(4)); }
+	uint64_t u64() { return uint(8); }
+	int32_t i32() { return static_cast<int32_t>(u32()); }
+	double f64() { uint64_t bits = u64(); double v; memcpy(&v, &bits, sizeof(v)); return v; }
+	const uint8_t* bytes(size_t n)
+	{
+		if (!has(n)) return nullptr;
+		const uint8_t* p = data + pos;
+		pos += n;
+		return p;
+	}
+	uint64_t varint()
+	{
+		uint64_t v = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t b = u8();
+			v |= static_cast<uint64_t>(b & 0x7F) << shift;
+			if (!(b & 0x80)) return v;
+		}
+		ok = false;
+		return 0;
+	}
+};
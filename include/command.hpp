@@ -1,6 +1,12 @@
 #pragma once
 
 #include <iostream> //For debugging
+#include <cstddef>
+
+constexpr size_t UNDO_HISTORY_DEFAULT_BUDGET = 64 << 20; // Bytes of commands kept for undo and redo
+
+class EditJournal;
+class LiveSync;
 
 class Command
 {
@@ -11,6 +17,12 @@ public:
 	virtual void redo() = 0;
 	virtual void undo() = 0;
 
+	// Records what redo() or undo() (undone) did to the map, once it has been done
+	virtual void journal(EditJournal& j, bool undone) const { (void)j; (void)undone; }
+	virtual void sync(LiveSync& s, bool undone) const { (void)s; (void)undone; }
+
+	virtual size_t getSize() const = 0; // Bytes held, counted against the undo history budget
+
 private:
 
 };
\ No newline at end of file
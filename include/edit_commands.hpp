@@ -7,58 +7,79 @@
 
 #include "vec.hpp"
 #include "map.hpp"
+#include "journal.hpp"
+#include "live_sync.hpp"
+#include "tile_diff.hpp"
+
+// Both keep what they changed as a TileDiff in the undo history's pool
 
 class SetTileCommand : public Command
 {
 public:
-	SetTileCommand(Map& map, vec2i position, bool show) : m(map), s(show) { p.push_back(position); redo(); }
-	SetTileCommand(Map& map, std::vector<vec2i> positions, bool show) : m(map), p(positions), s(show) { redo(); }
-	void redo() override { for (auto &t : p) setTile(m, t, s); }
-	void undo() override { for (auto &t : p) setTile(m, t, !s); }
+	SetTileCommand(Map& map, vec2i position, bool show, std::pmr::memory_resource* pool) : SetTileCommand(map, std::vector<vec2i>{position}, show, pool) {}
+	SetTileCommand(Map& map, const std::vector<vec2i>& positions, bool show, std::pmr::memory_resource* pool) : m(map), tiles(pool), s(show)
+	{
+		tiles.assign(positions);
+		redo();
+	}
+	void redo() override { apply(s); }
+	void undo() override { apply(!s); }
+	void journal(EditJournal& j, bool undone) const override { j.logTiles(m, tiles.positions(), undone ? !s : s); }
+	void sync(LiveSync& l, bool undone) const override { l.sendSpans(m, tiles, undone ? !s : s); }
+	size_t getSize() const override { return sizeof(*this) + tiles.getSize(); }
 
 private:
 	Map& m;
-	std::vector<vec2i> p;
+	TileDiff tiles; // Shown where a tile was edited
 	bool s;
+
+	void apply(bool show)
+	{
+		tiles.forEachSpan([this, show](int y, int x0, int x1) { setTileRect(m, {x0, y}, {x1, y}, show); });
+	}
 };
 
 class FillTileCommand : public Command
 {
 public:
-	FillTileCommand(Map& map, bool show, vec2i start_fill, vec2i end_fill) : s_fill(start_fill), e_fill(end_fill)
+	FillTileCommand(Map& map, bool show, vec2i start_fill, vec2i end_fill, std::pmr::memory_resource* pool) : m(map), s(show), s_fill(start_fill), e_fill(end_fill), previous(pool)
 	{
-		std::vector<vec2i> tiles;
-		vec2i t_start_fill, t_end_fill;
-
-		t_start_fill.x = std::min(s_fill.x, e_fill.x);
-		t_start_fill.y = std::min(s_fill.y, e_fill.y);
-		t_end_fill.x = std::max(s_fill.x, e_fill.x);
-		t_end_fill.y = std::max(s_fill.y, e_fill.y);
-
-		for (int x = t_start_fill.x; x <= t_end_fill.x; ++x)
-		{
-			for (int y = t_start_fill.y; y <= t_end_fill.y; ++y)
-			{
-				if (isTileShown(map, vec2i{x, y}) != show) tiles.push_back(vec2i{x, y});
-			}
-		}
+		// Keep the previous contents of the rectangle so undo can paste them back
+		if (m.v_tiles.clip(s_fill, e_fill)) previous.assign(s_fill, m.v_tiles.copyRect(s_fill, e_fill));
 
-		cmd = std::make_unique<SetTileCommand>(map, tiles, show);
 		redo();
 	}
 
 	void redo() override
 	{
-		cmd->redo();
+		if (!previous.empty()) setTileRect(m, s_fill, e_fill, s);
 	}
 	void undo() override
 	{
-		cmd->undo();
+		if (!previous.empty()) setTiles(m, s_fill, previous.decode());
 	}
+	void journal(EditJournal& j, bool undone) const override
+	{
+		if (previous.empty()) return;
+
+		if (undone) j.logPaste(m, s_fill, previous.decode());
+		else j.logRect(m, s_fill, e_fill, s);
+	}
+	void sync(LiveSync& l, bool undone) const override
+	{
+		if (previous.empty()) return;
+
+		if (undone) l.sendPaste(m, s_fill, previous.decode());
+		else l.sendRect(m, s_fill, e_fill, s);
+	}
+	size_t getSize() const override { return sizeof(*this) + previous.getSize(); }
 
 private:
+	Map& m;
+	bool s;
+
 	vec2i s_fill;
 	vec2i e_fill;
 
-	std::unique_ptr<SetTileCommand> cmd;
+	TileDiff previous;
 };
\ No newline at end of file
@@ -8,5 +8,7 @@ enum
     AXE_EDITOR_EVENT_ZOOM_IN,
     AXE_EDITOR_EVENT_ZOOM_OUT,
     AXE_EDITOR_EVENT_SHOWHIDE_GRID,
-    AXE_EDITOR_EVENT_COPY_DATA
+    AXE_EDITOR_EVENT_COPY_DATA, // data1 is the TileSnapshotChannel version just published, the viewer reads the channel itself
+    AXE_EDITOR_EVENT_LIVE_SYNC, // data1 is the LiveSync sequence of the last delta sent
+    AXE_EDITOR_EVENT_WAKE_VIEWER // Carries nothing, gets an idle viewer out of al_wait_for_event to see it should stop
 };
\ No newline at end of file
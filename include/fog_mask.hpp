@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <allegro5/allegro.h>
+
+#include "view.hpp"
+#include "tile_bitset.hpp"
+
+// Fog of war as a bitmap with one pixel per tile, opaque white where the tile
+// is hidden and clear where it is shown. Drawn scaled up by the tile size and
+// tinted with the fog colour, so the whole map's fog is one draw per page no
+// matter how many tiles are visible. Split into pages like MapImage, since a
+// big map can have more tiles per side than the max texture size.
+struct FogMask
+{
+	int width = 0;	// In tiles
+	int height = 0;
+	int page_size = 0;
+	int cols = 0;
+	int rows = 0;
+	std::vector<ALLEGRO_BITMAP*> pages;
+	uint64_t stamp = 0; // Edit stamp of the tiles the pages were last synced to
+};
+
+// Re-uploads the rows with a stamp newer than the mask's, or everything if the size changed.
+// Must run on the thread that owns the display the mask is drawn on.
+bool updateFogMask(FogMask& mask, const TileBitset& tiles, const std::vector<uint64_t>& row_stamps, uint64_t edit_stamp);
+void destroyFogMask(FogMask& mask);
+bool isFogMaskReady(const FogMask& mask);
+
+void drawFogMask(const FogMask& mask, const View::ViewPort& v, int tile_size, const vec2i& tl, const vec2i& br, const ALLEGRO_COLOR& fog); // Tile rect [tl, br]
@@ -3,8 +3,10 @@
 #include "imgui.h"
 #include "imgui_impl_allegro5.h"
 #include "util.hpp"
+#include "texture_budget.hpp"
 
 #include <string>
+#include <vector>
 
 #include <allegro5/allegro.h>
 
@@ -21,7 +23,17 @@ enum
     AXE_GUI_EVENT_NEW_MAP,
     AXE_GUI_EVENT_LOAD_MAP,
     AXE_GUI_EVENT_FILE_DIALOG_CREATE,
-    AXE_GUI_EVENT_FILE_DIALOG_FINISHED
+    AXE_GUI_EVENT_FILE_DIALOG_FINISHED,
+    AXE_GUI_EVENT_CANCEL_IMPORT,
+    AXE_GUI_EVENT_SET_TEXTURE_BUDGET,
+    AXE_GUI_EVENT_SET_RENDER_MODE,
+    AXE_GUI_EVENT_SET_RENDER_CACHE,
+    AXE_GUI_EVENT_SAVE_TO_BUNDLE,
+    AXE_GUI_EVENT_OPEN_BUNDLE_MAP,
+    AXE_GUI_EVENT_SET_AUTOSAVE,
+    AXE_GUI_EVENT_SET_LIVE_SYNC,
+    AXE_GUI_EVENT_SET_UNDO_BUDGET,
+    AXE_GUI_EVENT_JUMP_HISTORY
 };
 
 enum GUI_STATE
@@ -47,6 +59,13 @@ public:
     void render();
     void setFileBufferText(std::string path);
     std::string getFileBufferText() { return std::string(Gui::load_file_buffer); }
+    void setImportStatus(bool importing, float progress, const std::string& stage);
+    void setTextureStats(const TextureBudgetStats& stats);
+    void setLoopStats(double wakeups_per_sec, double frames_per_sec, double cpu_percent);
+    void setAutosaveStats(double capture_time, double write_time, uint64_t saves);
+    void setUndoStats(size_t bytes, size_t steps, size_t cursor);
+    void setBundleMaps(const std::vector<std::string>& names);
+    std::string getBundleMap(int index) const;
 
     ALLEGRO_EVENT_SOURCE *getEventSource();
 
@@ -58,10 +77,34 @@ private:
 
     int renderMainMenu(); // Returns height of menu
     void renderInitiativeTracker(int menu_height);
+    void renderImportProgress();
+    void renderStatusBar();
 
     // Data
     GUI_STATE state;
     bool m_show_demo_window;
     int m_tile_size;
+    bool m_importing;
+    float m_import_progress;
+    std::string m_import_stage;
+    TextureBudgetStats m_texture_stats;
+    int m_texture_budget_mb;
+    bool m_fog_mask;
+    bool m_render_cache;
+    bool m_live_sync;
+    bool m_embed_decoded;
+    std::vector<std::string> m_bundle_maps;
+    double m_wakeups_per_sec;
+    double m_frames_per_sec;
+    double m_cpu_percent;
+    int m_autosave_interval;
+    int m_autosave_generations;
+    double m_autosave_capture_ms;
+    double m_autosave_write_ms;
+    uint64_t m_autosaves;
+    int m_undo_budget_mb;
+    size_t m_undo_bytes;
+    size_t m_undo_steps;
+    int m_history_cursor;
     static char load_file_buffer[256];
 };
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "map_image.hpp"
+
+// Decoded image pyramids are cached on disk as raw RGBA8 so reopening a map
+// only has to hash the source file and map the cache entry.
+// Entries are named by the content hash of the source and also remember its
+// size and mtime, a mismatch on any of them counts as stale.
+
+constexpr uint64_t IMAGE_CACHE_DEFAULT_LIMIT = uint64_t(2) << 30; // 2 GiB
+
+struct ImageCacheKey
+{
+	std::string entry_path;
+	uint64_t source_hash = 0;
+	uint64_t source_size = 0;
+	int64_t source_mtime = 0;
+};
+
+void setImageCacheDir(const std::string& dir); // Empty string disables the cache
+void setImageCacheLimit(uint64_t bytes);
+std::string getImageCacheDir();
+uint64_t getImageCacheLimit();
+
+bool getImageCacheKey(const std::string& source_path, ImageCacheKey& key);
+bool loadCachedImage(DecodedImage& img, const ImageCacheKey& key);
+bool storeCachedImage(const DecodedImage& img, const ImageCacheKey& key);
+void trimImageCache(); // Evicts least recently used entries until the cache fits its limit
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "map_image.hpp"
+
+enum IMPORT_STAGE
+{
+	IMPORT_QUEUED,
+	IMPORT_DECODE,
+	IMPORT_LEVELS,
+	IMPORT_SLICE,
+	IMPORT_UPLOAD,	// CPU work is done, waiting for the display thread
+	IMPORT_DONE,
+	IMPORT_FAILED,
+	IMPORT_CANCELLED
+};
+
+struct ImportStats
+{
+	uint64_t source_bytes = 0;
+	bool cache_hit = false;
+
+	double decode_time = 0.0;
+	double levels_time = 0.0;
+	double slice_time = 0.0;
+	double upload_time = 0.0;
+
+	double cpuTime() const { return decode_time + levels_time + slice_time; }
+	double throughput() const; // MB/s of source image through the CPU stages
+};
+
+constexpr double IMPORT_UPLOAD_SLICE = 0.004; // Seconds of page uploads per upload() call, a quarter of a 60 Hz frame
+
+// Turns an image file into a MapImage in stages: decode (or the image cache),
+// downscaled levels and page slicing run on the worker pool, and only upload()
+// has to run on the display thread, a time slice at a time.
+class ImageImport
+{
+public:
+	ImageImport(const std::string& path, int page_size, bool slice_pages = true);
+	~ImageImport(); // Cancels, the worker lets go of its state once it notices. Must run on the display thread.
+
+	ImageImport(const ImageImport& other) = delete;
+	ImageImport& operator=(const ImageImport& other) = delete;
+
+	void cancel();
+
+	IMPORT_STAGE getStage() const;
+	const char* getStageName() const;
+	float getProgress() const; // 0 - 1 over every stage
+	const std::string& getPath() const;
+	ImportStats getStats() const; // Only complete once the stage is IMPORT_UPLOAD or later
+
+	bool isReadyForUpload() const { return getStage() == IMPORT_UPLOAD; }
+	bool isFinished() const;
+
+	// Uploads pages, coarsest level first, for about time_budget seconds and at least one page.
+	// Call it every tick until the stage is IMPORT_DONE. Returns false if the upload failed or was cancelled.
+	bool upload(double time_budget = IMPORT_UPLOAD_SLICE);
+	bool takeImage(MapImage& img); // Once the stage is IMPORT_DONE
+
+	// The image with its coarsest level resident, to draw in place of the map while the rest uploads
+	const MapImage* getPlaceholder() const { return placeholder_ready ? &image : nullptr; }
+
+	struct State; // Shared with the worker task, which may outlive the ImageImport
+
+private:
+	std::shared_ptr<State> state;
+
+	// Display thread only
+	MapImage image;
+	std::vector<size_t> level_offsets; // Index of each level's first page in the sliced pages
+	int upload_level = -1;
+	int upload_page = 0;
+	size_t pages_uploaded = 0;
+	size_t pages_total = 0;
+	bool placeholder_ready = false;
+};
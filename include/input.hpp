@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <functional> //for std::function & std::bind
 #include <map>
+#include <string>
+#include <vector>
 
 #include <allegro5/allegro.h>
 
@@ -20,6 +23,34 @@ enum MOUSE
 	CUSTOM_ALLEGRO_KEY_MAX
 };
 
+// Modifier combinations a key can be bound under
+enum INPUT_CHORD
+{
+	CHORD_NONE = 0,
+	CHORD_CTRL = 1,
+	CHORD_SHIFT = 2,
+	CHORD_ALT = 4,
+
+	CHORD_COUNT = 8
+};
+
+constexpr char KEYBINDS_PATH[] = "keybinds.cfg";
+
+/*	Keys and mouse buttons are bound to named actions, looked up in a flat table
+	by modifier chord and key. A chord with nothing bound falls back to its subsets,
+	most modifiers first: Ctrl+Shift+Z tries Ctrl+Shift, then Ctrl, then Shift, then
+	Z alone. So extra modifiers don't get in the way, Ctrl+Shift+Z still undoes and a
+	mouse button still works with Shift held. An action's release
+	callback runs for the action its press ran, whatever modifiers are up by then.
+
+	Bindings are text, one per line, the same for the defaults and keybinds.cfg:
+		# comment
+		undo = ctrl+z
+		reveal = mouse_left
+	An action named in a file loses the bindings it had before, the lines after
+	that add to it. Keys use Allegro's key names, mice mouse_left, mouse_right,
+	mouse_middle, mouse_button4, mouse_button5, wheel_up and wheel_down.
+*/
 class InputHandler
 {
 public:
@@ -51,22 +82,44 @@ public:
 	vec2i getMousePos() const;
 	bool isMouseInWindow() const;
 
-	void setKeybind(int key, std::function<void(void)> callback, bool onPressed = true);
-	void clearKeybind(int key);
-	void clearKeybinds();
-	void callKeybind(int key, bool pressed = true);
-	
+	// Actions can be bound before they are set, and keep their bindings when cleared
+	void setAction(const std::string& name, std::function<void(void)> on_pressed, std::function<void(void)> on_released = nullptr);
+	void clearAction(const std::string& name);
+
+	bool bind(const std::string& name, const std::string& keys); // keys as in a bindings file, "ctrl+z"
+	void unbind(const std::string& name);
+	// source names the text in error messages. Without new_actions only actions that already exist can be bound.
+	bool loadBindings(const std::string& text, const std::string& source, bool new_actions = true);
+	bool loadBindingsFile(const std::string& file); // A missing file is fine and returns true, the defaults stay
+
 private:
 	int modifiers;
-
-	bool mouse_wheel_up;
-	bool mouse_wheel_down;
 	vec2i mouse_position;
 
-	bool keys_pressed[CUSTOM_ALLEGRO_KEY_MAX];
-	bool keys_held[CUSTOM_ALLEGRO_KEY_MAX];
-	bool keys_released[CUSTOM_ALLEGRO_KEY_MAX];
-
-	std::map<int, std::function<void(void)> > keybinds_r;
-	std::map<int, std::function<void(void)> > keybinds_p;
+	// Every event starts a new generation, so an edge only counts in the one it happened in
+	// and nothing has to be cleared. releaseKeys() also starts a new hold epoch.
+	uint64_t generation;
+	uint64_t hold_epoch;
+	uint64_t keys_pressed[CUSTOM_ALLEGRO_KEY_MAX];	// Generation of the last press
+	uint64_t keys_released[CUSTOM_ALLEGRO_KEY_MAX];	// Generation of the last release
+	uint64_t keys_held[CUSTOM_ALLEGRO_KEY_MAX];		// Hold epoch when pressed, 0 once released
+
+	struct Action
+	{
+		std::string name;
+		std::function<void(void)> on_pressed;
+		std::function<void(void)> on_released;
+	};
+
+	std::vector<Action> actions;
+	std::map<std::string, uint16_t> action_ids;
+	uint16_t bindings[CHORD_COUNT][CUSTOM_ALLEGRO_KEY_MAX];	// Action index + 1, 0 for nothing
+	uint16_t held_actions[CUSTOM_ALLEGRO_KEY_MAX];			// What the last press of each key ran
+
+	std::map<std::string, int> key_names; // Lower case, filled on first use
+
+	uint16_t getActionId(const std::string& name);
+	int parseKey(const std::string& name);
+	void press(int key);
+	void release(int key);
 };
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vec.hpp"
+#include "map.hpp"
+#include "tile_bitset.hpp"
+
+/*	Edit journals (<map file>.journal.<sequence>)
+
+	Every committed edit, undo and redo is appended to a journal named after
+	the file the map was last saved to or loaded from and the sequence number
+	it starts after, so a crash only loses the last batch. Journals replay onto
+	a base, the map file itself when it carries a matching JRNL section, or a
+	copy written beside the journal (<journal>.base) on the worker pool when it
+	doesn't. Until a new base is written the journal before it stays in the
+	chain, so the map file is only ever written by a save.
+
+	JOURNAL_POINTER_PATH names the live chain, one path a line: the map file,
+	the base, then every journal in replay order. A save or a clean exit
+	deletes it along with the chain, so only a crash leaves records to replay.
+
+	Version 0x0100, every field little-endian:
+		Header, 32 bytes
+			0	"AXJ"
+			3	u16 version
+			5	u8[3] reserved
+			8	u64 journal id, matches the JRNL section of the base
+			16	u64 sequence number the journal starts after
+			24	u8[4] reserved
+			28	u32 CRC-32 of bytes 0-27
+
+		Records, until the end of the file
+			u32 payload size, u32 CRC-32 of the payload
+			payload
+				u64 sequence number, one more than the previous record
+				u8 operation, u8 show
+				JOURNAL_TILES	varint count, count x { varint x, varint y }
+				JOURNAL_RECT	varint left, top, right, bottom, inclusive
+				JOURNAL_PASTE	varint left, top, width, height, then varint runs
+								over the rect in row-major order, alternating
+								hidden and shown, hidden first
+
+	Replay stops at the first record that is cut short, fails its checksum or
+	skips a sequence number, which is where a crash left the file.
+*/
+
+constexpr uint16_t JOURNAL_VERSION = 0x0100;
+constexpr char JOURNAL_EXT[] = ".journal";
+constexpr char JOURNAL_BASE_EXT[] = ".base";
+constexpr char JOURNAL_POINTER_PATH[] = "journal.active";
+constexpr size_t JOURNAL_HEADER_SIZE = 32;
+constexpr uint64_t JOURNAL_COMPACT_SIZE = 4 * 1024 * 1024; // A new base and journal are started once it grows past this
+
+enum JOURNAL_OP
+{
+	JOURNAL_TILES,
+	JOURNAL_RECT,
+	JOURNAL_PASTE
+};
+
+// The live chain, what recovery replays
+struct JournalPointer
+{
+	std::string map_file;				// What a recovered map saves back to
+	std::string base;					// Map file the journals replay onto
+	std::vector<std::string> journals;	// Replay order
+};
+
+uint64_t makeJournalId();
+std::string makeJournalPath(const std::string& map_file, uint64_t base_seq);
+
+bool writeJournalPointer(const std::string& file, const JournalPointer& p); // Replaced atomically
+bool readJournalPointer(const std::string& file, JournalPointer& p);
+
+// Applies the records after m.journal_seq if the journal belongs to the map, returns how many were applied
+int replayJournal(const std::string& file, Map& m);
+
+// Records are encoded on the calling thread and written and synced on the worker
+// pool in batches, everything queued while a write is running goes out with the next one.
+class EditJournal
+{
+public:
+	EditJournal();
+	~EditJournal();
+
+	EditJournal(const EditJournal& other) = delete;
+	EditJournal& operator=(const EditJournal& other) = delete;
+
+	// Starts an empty journal for a map saved up to base_seq, replacing the file
+	bool open(const std::string& file, uint64_t id, uint64_t base_seq);
+	void close(); // Waits for queued records to reach the disk
+
+	bool isOpen() const { return !path.empty(); }
+	const std::string& getPath() const { return path; }
+	uint64_t getSize() const { return size; } // Bytes written or queued
+
+	// Each bumps m.journal_seq, nothing is recorded while closed
+	void logTiles(Map& m, const std::vector<vec2i>& positions, bool show);
+	void logRect(Map& m, vec2i tl, vec2i br, bool show);
+	void logPaste(Map& m, vec2i tl, const TileBitset& tiles);
+
+	struct State; // Shared with the write task
+
+private:
+	std::shared_ptr<State> state;
+	std::string path;
+	uint64_t size = 0;
+
+	void queue(const std::vector<uint8_t>& payload);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "vec.hpp"
+#include "map.hpp"
+#include "tile_bitset.hpp"
+#include "spsc_ring.hpp"
+#include "tile_snapshot.hpp"
+#include "tile_diff.hpp"
+
+using std_clk = std::chrono::steady_clock;
+
+constexpr size_t LIVE_SYNC_RING_SIZE = 4096; // Deltas in flight before the viewer falls back to a snapshot
+
+// One rectangle set to shown or hidden, a row span when tl.y == br.y
+struct VisibilityDelta
+{
+	uint64_t seq = 0;
+	vec2i tl;
+	vec2i br; // Inclusive
+	bool show = false;
+	std_clk::time_point time; // When the edit was committed, for the latency report
+};
+
+/*	Streams committed edits from the editor to the viewer as they happen.
+
+	Each command, undo and redo becomes a few deltas numbered one after the
+	other and pushed onto a ring only the two threads share. When the ring is
+	full the rest are dropped and a snapshot tagged with the last number is
+	published instead, which the viewer switches to when it finds the gap.
+*/
+class LiveSync
+{
+public:
+	explicit LiveSync(std::shared_ptr<TileSnapshotChannel> snapshots, size_t capacity = LIVE_SYNC_RING_SIZE);
+
+	LiveSync(const LiveSync& other) = delete;
+	LiveSync& operator=(const LiveSync& other) = delete;
+
+	// Editor thread, called once the map has the edit
+	void sendSpans(const Map& m, const TileDiff& tiles, bool show); // A delta per row span of the shown tiles
+	void sendRect(const Map& m, vec2i tl, vec2i br, bool show);
+	void sendPaste(const Map& m, vec2i tl, const TileBitset& tiles); // Row spans of each run
+
+	uint64_t getSequence() const { return sequence; } // Last delta sent, snapshots published by the editor are tagged with it
+
+	// Viewer thread. Brings m up to everything sent so far, taking the latest snapshot when it is
+	// ahead of the deltas. Returns the deltas applied, oldest is when the first of them was sent.
+	int receive(Map& m, std::shared_ptr<const TileSnapshot>& applied, std_clk::time_point& oldest);
+	uint64_t getResyncs() const { return resyncs; } // Snapshots that were ahead of the deltas, mostly after the ring filled up
+
+private:
+	SpscRing<VisibilityDelta> ring;
+	std::shared_ptr<TileSnapshotChannel> snapshots;
+
+	// Editor thread
+	uint64_t sequence = 0;
+	bool overflowed = false;
+	std_clk::time_point commit_time;
+
+	// Viewer thread
+	uint64_t received = 0;
+	uint64_t resyncs = 0;
+
+	void push(vec2i tl, vec2i br, bool show);
+	void finish(const Map& m);
+	bool takeSnapshot(Map& m, std::shared_ptr<const TileSnapshot>& applied);
+};
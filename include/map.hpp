@@ -1,33 +1,101 @@
 #pragma once
 
 #include "view.hpp"
+#include "tile_bitset.hpp"
+#include "map_image.hpp"
+#include "fog_mask.hpp"
+#include "mdf.hpp"
 
+#include <string>
 #include <vector>
 
+// Grid lines kept in world coordinates and only rebuilt when the tile size,
+// the covered tile rect or the fade step changes. The rect has a margin
+// around the view, so scrolling doesn't rebuild every frame.
+struct GridCache
+{
+	View::LineBatch lines;
+	int tile_size = 0;
+	int fade_step = -1;
+	vec2i tl = {0, 0};
+	vec2i br = {-1, -1};
+};
+
+// The composited map, fog and grid at one scale, with a margin around the view.
+// Panning inside the margin is a single blit, edits only redraw their rows.
+struct RenderCache
+{
+	ALLEGRO_BITMAP* target = nullptr;
+	vec2d world_tl;			// World position of the target's top left pixel
+	double scale = 0.0;
+	uint64_t stamp = 0;		// Map edit stamp the target is in sync with
+	int tile_size = 0;
+	int mode = -1;
+	bool draw_grid = false;
+	bool show_hidden = false;
+};
+
+enum MAP_RENDER_MODE
+{
+	RENDER_FOG_MASK,	// Fog drawn from a one pixel per tile mask, a few draws per frame
+	RENDER_TILES		// Fog drawn one rectangle per run of hidden tiles, the fallback
+};
+
 struct Map
 {
-	ALLEGRO_BITMAP* bmp = nullptr;
+	MapImage image;
 	std::string path;
 	int width;
 	int height;
 	int tile_size;
 	bool needs_save;
 
-	std::vector<bool> v_tiles;
+	TileBitset v_tiles;
+
+	// Every edit takes a new edit_stamp, increasing across all maps, and stamps the rows it
+	// touched, so the fog mask only re-uploads rows newer than the stamp it last synced to
+	uint64_t edit_stamp = 0;
+	std::vector<uint64_t> row_stamps;
+	FogMask fog;
+	GridCache grid;
+	RenderCache render_cache;
+
+	// One bit per MDF visibility block changed since the last save to saved_file,
+	// so the next save there only appends those blocks
+	std::vector<bool> dirty_blocks;
+	std::string saved_file;
+	uint64_t saved_file_size = 0;
+
+	// Saved with the map, so an edit journal only replays onto the save it continues
+	uint64_t journal_id = 0;
+	uint64_t journal_seq = 0;	// Last journaled edit the tiles include
 };
 
+void setMapRenderMode(MAP_RENDER_MODE mode);
+MAP_RENDER_MODE getMapRenderMode();
+void setMapRenderCache(bool enabled);
+bool getMapRenderCache();
+
 bool createMap(Map& m, std::string path_to_map, int tile_size);
+bool createMap(Map& m, MapImage& image, std::string path_to_map, int tile_size); // Takes over an uploaded image
+// A map read from file (empty for a bundle) with readMapFile() or readBundleMap(), takes over its uploaded image
+bool createMap(Map& m, MapImage& image, const std::string& file, const MapFileInfo& info, TileBitset& tiles, View::ViewPort& v);
 void destroyMap(Map& m);
 bool reloadMap(Map& m);
 
 bool saveMap(Map& m, std::string file, const View::ViewPort& v);
 bool loadMap(Map& m, std::string file, View::ViewPort& v);
+bool loadMapFromBundle(Map& m, const std::string& bundle, const std::string& name, View::ViewPort& v);
+bool saveMapToBundle(Map& m, const std::string& bundle, const std::string& name, const View::ViewPort& v, bool embed_decoded);
 
-void drawMap(const Map& m, const View::ViewPort& v, bool draw_grid, bool show_hidden);
+void drawMap(Map& m, const View::ViewPort& v, bool draw_grid, bool show_hidden);
 
 void hideTile(Map& m, const vec2i& position);
 void showTile(Map& m, const vec2i& position);
 void setTile(Map& m, const vec2i& position, bool show);
+void setTileRect(Map& m, const vec2i& top_left, const vec2i& bottom_right, bool show);
+void setTiles(Map& m, const vec2i& top_left, const TileBitset& tiles);
+void replaceTiles(Map& m, const TileBitset& tiles); // Same size as the map, e.g. a copy from the editor
 bool isTileShown(const Map& m, const vec2i& position);
 
 vec2i getTilePos(const Map& m, const View::ViewPort& v, const vec2d& screen_pos);
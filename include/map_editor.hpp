@@ -1,7 +1,10 @@
 #pragma once
 
+#include <future>
 #include <list>
+#include <memory_resource>
 #include <vector>
+#include <string>
 
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_font.h>
@@ -10,6 +13,36 @@
 #include "view.hpp"
 #include "map.hpp"
 #include "edit_commands.hpp"
+#include "image_import.hpp"
+#include "autosave.hpp"
+#include "journal.hpp"
+#include "tile_snapshot.hpp"
+#include "live_sync.hpp"
+#include "visibility_history.hpp"
+
+constexpr char MAP_SAVE_PATH[] = "map-save.mdf";
+constexpr char CAMPAIGN_BUNDLE_PATH[] = "campaign.axb";
+
+// Registered before keybinds.cfg is read, which can rebind any of them
+constexpr char EDITOR_BINDINGS[] =
+	"undo = ctrl+z\n"
+	"redo = ctrl+y\n"
+	"save = ctrl+s\n"
+	"load = ctrl+l\n"
+	"center_view = ctrl+c\n"
+	"reset_zoom = r\n"
+	"toggle_hidden = space\n"
+	"toggle_grid = g\n"
+	"toggle_viewer_grid = ctrl+g\n"
+	"viewer_zoom_in = up\n"
+	"viewer_zoom_out = down\n"
+	"send_to_viewer = u\n"
+	"zoom_in = wheel_up\n"
+	"zoom_out = wheel_down\n"
+	"pan = mouse_middle\n"
+	"move_viewer = ctrl+mouse_middle\n"
+	"reveal = mouse_left\n"
+	"hide = mouse_right\n";
 
 class MapEditor
 {
@@ -21,9 +54,22 @@ public:
 	void update(double delta_time);
 	void draw();
 
-	bool create(std::string image_path, int tile_size);
+	bool create(std::string image_path, int tile_size); // Starts an import, the map is swapped in by update()
 	bool save();
-	bool load(std::string path);
+	bool load(std::string path); // Reads the tiles and imports the image like create()
+	bool recover(); // On startup, rebuilds the map a crash left unsaved from the journal JOURNAL_POINTER_PATH names
+	bool saveToBundle(bool embed_decoded); // Adds or replaces this map in the campaign bundle
+	bool loadFromBundle(const std::string& name); // Also through an import
+	std::vector<std::string> getBundleMaps() const; // Names of the maps in the campaign bundle, from its table of contents
+	void autosave(); // Snapshots the map for the background autosave, called on the autosave timer
+	void setAutosaveGenerations(int generations) { autosaver.setGenerations(generations); }
+	AutosaveStats getAutosaveStats() const { return autosaver.getStats(); }
+	void setLiveSync(bool enabled); // Streams every edit to the viewer as it is made, a snapshot goes first to catch it up
+	void setUndoBudget(size_t bytes); // The oldest commands go once the history holds more, the last one is always kept
+	size_t getUndoMemory() const { return undo_bytes + history.getSize(); }
+	size_t getUndoSteps() const { return undo_stack.size() + redo_stack.size(); }
+	void jumpToHistory(size_t index); // 0 is the oldest step kept, getUndoSteps() the newest
+	size_t getHistoryCursor() const { return history.getCursor(); }
 	void undo();
 	void redo();
 	
@@ -44,6 +90,18 @@ public:
 	void fireEvent(int event_id);
 	ALLEGRO_EVENT_SOURCE *getEventSource();
 
+	bool isImporting() const;
+	float getImportProgress() const;
+	std::string getImportStage() const;
+	void cancelImport();
+
+	bool isAnimating(); // Importing or panning with held keys, the main loop only ticks while this is true
+
+	std::string getImagePath() const { return map.path; }
+	int getTileSize() const { return map.tile_size; }
+	std::shared_ptr<const DecodedImage> getDecodedImage() const { return map.image.source; }
+	std::shared_ptr<LiveSync> getLiveSync() const { return live_sync; }
+
 private: // TODO Reorganize
 	InputHandler &m_input;
 	ALLEGRO_EVENT_SOURCE m_event_source;
@@ -64,10 +122,53 @@ private: // TODO Reorganize
 	bool show_hidden;
 	bool draw_grid;
 
+	std::pmr::unsynchronized_pool_resource undo_pool; // Before the stacks, so it outlives the commands using it
 	std::list<std::unique_ptr<Command>> redo_stack;
 	std::list<std::unique_ptr<Command>> undo_stack;
-
+	size_t undo_bytes = 0; // Both stacks
+	VisibilityHistory history; // One step more than the stacks hold, the cursor is at undo_stack.size()
+	size_t undo_budget = UNDO_HISTORY_DEFAULT_BUDGET;
+
+	// What the running import turns into once its image is uploaded, a new map or one read from a file or bundle
+	struct PendingMap
+	{
+		int tile_size = 0;
+		bool loaded = false;
+		MapFileInfo info;
+		TileBitset tiles;
+		std::string file;			// Map file it was read from, empty for a bundle
+		std::string bundle_name;
+		JournalPointer recover;		// Journals replayed onto these tiles, read from their base, empty unless recovering
+	};
+
+	std::unique_ptr<ImageImport> import;
+	PendingMap pending;
+
+	std::string bundle_map_name; // Name in the campaign bundle, empty if the map didn't come from there
+
+	Autosaver autosaver;
+	EditJournal journal;
+	JournalPointer journal_files; // Live chain, written to JOURNAL_POINTER_PATH once it has a base
+	std::future<bool> journal_base_write; // Base for the open journal, written on the worker pool
+	uint64_t journal_compact_size = JOURNAL_COMPACT_SIZE; // Pushed back when a base fails to write
+	std::shared_ptr<TileSnapshotChannel> snapshots; // Read by the viewer thread, AXE_EDITOR_EVENT_COPY_DATA only says a new version is out
+	std::shared_ptr<LiveSync> live_sync;
+	bool live_sync_enabled = false;
+
+	void startImport(const std::string& image_path, PendingMap&& next);
+	void updateImport();
+	void finishLoad(Map& temp);
+	void swapInLoadedMap(Map& temp);
 	void pushCommand(std::unique_ptr<Command> c);
+	void clearHistory();
+	void trimHistory();
+	void journalCommand(const Command& c, bool undone);
+	void syncCommand(const Command& c, bool undone);
+	void startJournal();
+	bool openJournal();
+	void rebaseJournal();
+	void updateJournal();
+	void discardJournal();
 	std::vector<vec2i> tiles_to_edit;
 
 	void enableKeybinds();
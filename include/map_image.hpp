@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <allegro5/allegro.h>
+
+#include "view.hpp"
+#include "mapped_file.hpp"
+
+constexpr int MAP_IMAGE_PAGE_SIZE = 1024;	// Largest edge of one texture page, shrunk if the display can't do it
+constexpr int MAP_IMAGE_MAX_LEVELS = 4;		// Level n is 1/2^n of the source, 1/8 covers MIN_ZOOM
+
+// CPU copy of one level of the pyramid, tightly packed RGBA8 (premultiplied, as Allegro loads it).
+// Pixels are either owned, or point into the image cache file the DecodedImage keeps mapped.
+struct ImageLevel
+{
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> pixels;
+	const uint8_t* mapped = nullptr;
+
+	const uint8_t* data() const { return mapped ? mapped : pixels.data(); }
+	size_t bytes() const { return static_cast<size_t>(width) * static_cast<size_t>(height) * 4; }
+};
+
+struct DecodedImage
+{
+	std::vector<ImageLevel> levels;
+	std::shared_ptr<MappedFile> mapping;
+};
+
+// CPU copy of one texture page, sliced out of a level so it can be uploaded with one copy
+struct ImagePage
+{
+	int level = 0;
+	int col = 0;
+	int row = 0;
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> pixels;
+};
+
+bool decodeImage(DecodedImage& img, const std::string& path);
+bool decodeImage(DecodedImage& img, ALLEGRO_FILE* file, const std::string& ident); // ident is the extension, e.g. ".png"
+void buildImageLevels(DecodedImage& img);
+bool loadDecodedImage(DecodedImage& img, const std::string& path); // From a bundle or the image cache, or decode and cache it
+
+// Building blocks of buildImageLevels(), so the work can be split across threads
+ImageLevel createHalfLevel(const ImageLevel& src);
+void downsampleRows(const ImageLevel& src, ImageLevel& dst, int y0, int y1); // Fills dst rows [y0, y1)
+ImagePage sliceImagePage(const DecodedImage& img, int level, int col, int row, int page_size);
+
+// One level of the pyramid on the GPU, split into page bitmaps stored row-major.
+// A null page is not resident, either evicted or never uploaded.
+struct ImagePageLevel
+{
+	int width = 0;
+	int height = 0;
+	int cols = 0;
+	int rows = 0;
+	std::vector<ALLEGRO_BITMAP*> pages;
+	std::vector<uint64_t> last_used; // Use stamp of the last draw that needed each page
+};
+
+struct MapImage
+{
+	int width = 0;
+	int height = 0;
+	int page_size = 0;
+	std::vector<ImagePageLevel> levels;
+
+	std::shared_ptr<const DecodedImage> source; // Pages are reloaded from here, in memory or mapped from the image cache
+	uint64_t resident_bytes = 0;
+};
+
+bool loadMapImage(MapImage& img, const std::string& path);
+bool uploadMapImage(MapImage& img, std::shared_ptr<const DecodedImage> decoded); // Uploads what fits the texture budget
+
+// Uploading one page at a time, these must run on the thread that owns the display
+int getMapImagePageSize();
+void layoutMapImage(MapImage& img, std::shared_ptr<const DecodedImage> decoded, int page_size); // Sizes the page grid, every page starts null
+bool uploadImagePage(MapImage& img, const ImagePage& page);
+bool uploadImagePage(MapImage& img, int level, int col, int row); // From img.source
+bool uploadMapImagePages(MapImage& img); // From img.source, coarsest level first, stops at the texture budget
+void evictImagePages(MapImage& img, uint64_t keep_stamp); // Drops pages used before keep_stamp until under budget
+void destroyMapImage(MapImage& img);
+bool isMapImageLoaded(const MapImage& img);
+
+int getMapImageLevel(const MapImage& img, double scale);
+void drawMapImage(MapImage& img, const View::ViewPort& v, const vec2d& tl, const vec2d& br); // World rect [tl, br), reloads evicted pages
+void drawMapImagePreview(const MapImage& img, const View::ViewPort& v); // Resident pages of the coarsest level only, dimmed, never uploads
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return ptr != nullptr; }
+	const uint8_t* data() const { return ptr; }
+	size_t size() const { return len; }
+
+private:
+	const uint8_t* ptr = nullptr;
+	size_t len = 0;
+
+#ifdef WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vec.hpp"
+#include "tile_bitset.hpp"
+
+/*	MDF map files
+
+	Version 0x0100 wrote native-endian structs and one byte per tile. It can
+	still be read, but maps are always saved as 0x0200.
+
+	Version 0x0200, every field little-endian:
+		Header, 32 bytes
+			0	"MDF"
+			3	u16 version
+			5	u8[3] reserved
+			8	u64 offset of the section table
+			16	u32 section count
+			20	u32 CRC-32 of bytes 0-19
+			24	u8[8] reserved
+
+		Section table, at the offset in the header
+			section count x { u8 tag[4], u32 crc, u64 offset, u64 size }
+			u32 CRC-32 of the entries
+
+		"INFO" section
+			f64 view x, f64 view y, f64 view scale
+			i32 width, i32 height, i32 tile size
+			u32 path length, path bytes (UTF-8, no terminator)
+
+		"VIS " section, the visibility index
+			u32 width, u32 height, u32 rows per block, u32 block count
+			block count x { u64 offset, u32 size, u32 crc, u8 encoding, u8[3] reserved }
+
+		"JRNL" section, only if the map has an edit journal
+			u64 journal id, u64 sequence number of the last journaled edit in the file
+
+	Each block covers a band of rows. Its data lives anywhere in the file at
+	the absolute offset given in the index and has its own CRC-32.
+	Saves after the first append the changed blocks and a new table, then
+	rewrite the header, so the file can hold blocks nothing points at.
+	Sections and blocks not named here are skipped, so they can be added
+	without a version bump.
+*/
+
+constexpr uint16_t MDF_VERSION_1 = 0x0100;
+constexpr uint16_t MDF_VERSION_2 = 0x0200;
+constexpr int MDF_BLOCK_ROWS = 64;
+
+enum MDF_BLOCK_ENCODING
+{
+	MDF_BLOCK_HIDDEN,	// Every tile hidden, no data
+	MDF_BLOCK_SHOWN,	// Every tile shown, no data
+	MDF_BLOCK_RAW,		// Rows of u64 words, bit x of a row is tile x
+	MDF_BLOCK_RLE		// Varint run lengths over the band in row-major order, alternating hidden and shown, hidden first
+};
+
+struct MapFileInfo
+{
+	std::string image_path;
+	int width = 0;
+	int height = 0;
+	int tile_size = 0;
+	vec2d view_pos = vec2d(0.0, 0.0);
+	double view_scale = 1.0;
+	uint16_t version = MDF_VERSION_2; // Version the file was read as
+	uint64_t journal_id = 0;	// 0 if there is no JRNL section
+	uint64_t journal_seq = 0;
+};
+
+// Always writes the latest version, to a temporary file that is synced and renamed over file
+bool writeMapFile(const std::string& file, const MapFileInfo& info, const TileBitset& tiles);
+
+// Appends the dirty blocks, new INFO and VIS sections and a new section table to a 0x0200 file, then points
+// the header at the new table. Returns false without touching the file if it isn't expected_size bytes,
+// doesn't match the map, or is mostly dead space, the caller should writeMapFile() then.
+bool appendMapFile(const std::string& file, const MapFileInfo& info, const TileBitset& tiles, const std::vector<bool>& dirty_blocks, uint64_t expected_size);
+bool writeMapData(const MapFileInfo& info, const TileBitset& tiles, std::vector<uint8_t>& out); // The whole file in memory, offsets relative to out[0]
+bool readMapFile(const std::string& file, MapFileInfo& info, TileBitset& tiles); // Maps the file, nothing is copied but the tiles
+bool readMapData(const uint8_t* data, size_t size, MapFileInfo& info, TileBitset& tiles); // Any version, every length is checked before use
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded queue for exactly one producer thread and one consumer thread, neither
+// ever waits on the other. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing
+{
+public:
+	explicit SpscRing(size_t capacity) : head(0), tail(0)
+	{
+		size_t n = 1;
+		while (n < capacity) n <<= 1;
+		slots.resize(n);
+		mask = n - 1;
+	}
+
+	SpscRing(const SpscRing& other) = delete;
+	SpscRing& operator=(const SpscRing& other) = delete;
+
+	// Producer only, false if the ring is full
+	bool push(const T& item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+
+		slots[t & mask] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only, false if the ring is empty
+	bool pop(T& item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+
+		item = slots[h & mask];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t capacity() const { return slots.size(); }
+
+private:
+	std::vector<T> slots;
+	size_t mask;
+
+	// On separate cache lines so the two threads don't keep stealing each other's
+	alignas(64) std::atomic<size_t> head; // Next slot to pop, written by the consumer
+	alignas(64) std::atomic<size_t> tail; // Next slot to push, written by the producer
+};
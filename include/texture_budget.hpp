@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+// Every MapImage page counts against one process wide budget, shared by the
+// editor and viewer displays. Pages are evicted least recently drawn first
+// and reloaded from the image's CPU copy when they come back into view.
+
+constexpr uint64_t TEXTURE_BUDGET_DEFAULT = uint64_t(512) << 20; // 512 MiB
+
+struct TextureBudgetStats
+{
+	uint64_t budget = 0;
+	uint64_t resident_bytes = 0;
+	uint64_t evictions = 0;		// Pages dropped to get back under budget
+	uint64_t reloads = 0;		// Pages uploaded again after being evicted or skipped
+	uint64_t reload_stalls = 0;	// Draws that had to wait on at least one reload
+};
+
+void setTextureBudget(uint64_t bytes);
+uint64_t getTextureBudget();
+TextureBudgetStats getTextureBudgetStats();
+
+bool isOverTextureBudget(uint64_t extra_bytes = 0);
+uint64_t nextTextureUseStamp(); // Increases every draw, pages remember the last one that used them
+
+void addResidentTextureBytes(uint64_t bytes);
+void removeResidentTextureBytes(uint64_t bytes);
+void countTextureEviction();
+void countTextureReload();
+void countTextureReloadStall();
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for CPU work that should stay off the display threads
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned threads = 0); // 0 picks hardware_concurrency - 1
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool& other) = delete;
+	ThreadPool& operator=(const ThreadPool& other) = delete;
+
+	void submit(std::function<void(void)> task);
+
+	// Calls fn(i) for every i in [0, n). The calling thread helps out, so this
+	// is safe to call from inside a pool task, and returns once every call is done.
+	void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+	unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void(void)>> tasks;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool stopping;
+};
+
+ThreadPool& getWorkerPool();
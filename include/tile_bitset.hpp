@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "vec.hpp"
+
+// One bit per tile, stored row-major in uint64_t words.
+// Every row starts on a new word (stride = ceil(width / 64)), and the unused
+// bits at the end of a row are always zero, so spans and rectangles can be
+// edited a whole word at a time and popcounts never see padding.
+class TileBitset
+{
+public:
+	TileBitset() : w(0), h(0), stride(0) {}
+	TileBitset(int width, int height, bool value = false) : w(0), h(0), stride(0) { assign(width, height, value); }
+
+	void assign(int width, int height, bool value = false); // Discards the previous contents
+	void clear();
+	void fill(bool value);
+
+	int width() const { return w; }
+	int height() const { return h; }
+	size_t wordsPerRow() const { return stride; }
+	size_t size() const { return static_cast<size_t>(w) * static_cast<size_t>(h); }
+	bool empty() const { return w == 0 || h == 0; }
+
+	bool inBounds(int x, int y) const { return x >= 0 && x < w && y >= 0 && y < h; }
+
+	// Unchecked single tile access, callers must check inBounds()
+	bool test(int x, int y) const { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+	void set(int x, int y, bool value)
+	{
+		uint64_t bit = uint64_t(1) << (x & 63);
+		uint64_t &word = row(y)[x >> 6];
+		word = value ? (word | bit) : (word & ~bit);
+	}
+
+	// Spans are inclusive [x0, x1] on row y, rectangles are inclusive [tl, br].
+	// Both are clipped to the bitset, so out of range input is harmless.
+	void setSpan(int y, int x0, int x1, bool value);
+	size_t countSpan(int y, int x0, int x1) const;
+	int findSpan(int y, int x0, int x1, bool value) const; // First x in span with value, or x1 + 1
+
+	void setRect(vec2i tl, vec2i br, bool value);
+	size_t countRect(vec2i tl, vec2i br) const;
+	bool testRect(vec2i tl, vec2i br, bool value) const; // True if every tile in the rect equals value
+
+	// Copies the (clipped) rectangle out into a new bitset, and writes one back at tl
+	TileBitset copyRect(vec2i tl, vec2i br) const;
+	void pasteRect(vec2i tl, const TileBitset& src);
+
+	// Orders the corners of a rectangle and clips it, returns false if nothing is left
+	bool clip(vec2i& tl, vec2i& br) const;
+
+	size_t count() const;
+
+	uint64_t* row(int y) { return data.data() + static_cast<size_t>(y) * stride; }
+	const uint64_t* row(int y) const { return data.data() + static_cast<size_t>(y) * stride; }
+	const std::vector<uint64_t>& words() const { return data; }
+
+	friend bool operator==(const TileBitset& lhs, const TileBitset& rhs) { return lhs.w == rhs.w && lhs.h == rhs.h && lhs.data == rhs.data; }
+	friend bool operator!=(const TileBitset& lhs, const TileBitset& rhs) { return !(lhs == rhs); }
+
+private:
+	int w;
+	int h;
+	size_t stride;
+	std::vector<uint64_t> data;
+};
+
+size_t popcountWords(const uint64_t* words, size_t n);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm> // std::min
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+#include "vec.hpp"
+#include "byte_io.hpp"
+#include "tile_bitset.hpp"
+
+// Runs over every tile of tiles in row-major order, alternating hidden and shown,
+// hidden first, each a varint, like MDF_BLOCK_RLE
+void writeTileRuns(ByteWriter& w, const TileBitset& tiles);
+bool readTileRuns(ByteReader& r, TileBitset& tiles);
+
+// A rectangle of tiles kept as its runs, what an edit command needs to redo or
+// undo itself. Large even areas come down to a few bytes, and the bytes come
+// from the pool the undo history hands out.
+class TileDiff
+{
+public:
+	explicit TileDiff(std::pmr::memory_resource* pool) : runs(pool) {}
+
+	void assign(vec2i top_left, const TileBitset& tiles);
+	void assign(const std::vector<vec2i>& positions); // Shown where a position is, over their bounding rectangle
+
+	bool empty() const { return w == 0 || h == 0; }
+	vec2i topLeft() const { return tl; }
+
+	TileBitset decode() const;
+	std::vector<vec2i> positions() const; // Every shown tile, in map coordinates
+
+	// Calls fn(y, x0, x1) for every span of shown tiles, in map coordinates
+	template <typename Fn>
+	void forEachSpan(Fn fn) const
+	{
+		ByteReader r(runs.data(), runs.size());
+		const uint64_t total = static_cast<uint64_t>(w) * h;
+		uint64_t pos = 0;
+		bool value = false;
+
+		while (pos < total)
+		{
+			uint64_t run = r.varint();
+			if (!r.ok || run > total - pos) return;
+
+			// A shown run can wrap over several rows
+			for (uint64_t i = pos, end = pos + run; value && i < end;)
+			{
+				uint64_t x = i % w;
+				uint64_t n = std::min(w - x, end - i);
+				fn(tl.y + static_cast<int>(i / w), tl.x + static_cast<int>(x), tl.x + static_cast<int>(x + n - 1));
+				i += n;
+			}
+
+			pos += run;
+			value = !value;
+		}
+	}
+
+	size_t getSize() const { return runs.capacity(); } // Bytes held outside the object, for the history budget
+
+private:
+	vec2i tl;
+	uint64_t w = 0;
+	uint64_t h = 0;
+	std::pmr::vector<uint8_t> runs;
+};
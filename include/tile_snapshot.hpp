@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "map.hpp"
+#include "tile_bitset.hpp"
+
+constexpr int TILE_SNAPSHOT_BLOCK_ROWS = 64;
+
+// An immutable copy of a map's visibility, split into bands of rows. Bands that
+// didn't change are shared with the previous version instead of copied.
+struct TileSnapshot
+{
+	uint64_t version = 0;
+	uint64_t delta_seq = 0; // Last live sync delta the snapshot already has, see LiveSync
+	int width = 0;
+	int height = 0;
+	std::vector<std::shared_ptr<const TileBitset>> blocks; // TILE_SNAPSHOT_BLOCK_ROWS rows each, the last may be shorter
+};
+
+// Copies the bands of m with a row stamped after since_stamp and shares the rest with prev, copies all of them
+// without a prev of the same size. version and delta_seq are left for the caller.
+std::shared_ptr<TileSnapshot> makeTileSnapshot(const Map& m, const TileSnapshot* prev, uint64_t since_stamp);
+
+TileBitset flattenTileSnapshot(const TileSnapshot& snapshot);
+size_t getTileSnapshotBlockSize(const TileSnapshot& snapshot, size_t block); // Bytes, for memory accounting
+
+// Hands visibility from the editor thread to the viewer. publish() builds a new
+// version next to the current one and swaps it in with one atomic store, and
+// readers hold on to whatever version they loaded for as long as they need it.
+class TileSnapshotChannel
+{
+public:
+	TileSnapshotChannel() = default;
+
+	TileSnapshotChannel(const TileSnapshotChannel& other) = delete;
+	TileSnapshotChannel& operator=(const TileSnapshotChannel& other) = delete;
+
+	// Editor thread only, copies the bands with rows stamped after the last publish
+	void publish(const Map& m, uint64_t delta_seq = 0);
+
+	// Any thread, never blocks on publish()
+	std::shared_ptr<const TileSnapshot> latest() const;
+
+private:
+	std::shared_ptr<const TileSnapshot> current; // Only accessed through std::atomic_load / std::atomic_store
+
+	uint64_t published_stamp = 0; // Editor thread only
+};
+
+// Brings m up to snapshot, only pasting the bands that differ from applied (the snapshot m was last brought to, may be null).
+// Returns false if the snapshot is for a map of a different size.
+bool applyTileSnapshot(Map& m, const TileSnapshot& snapshot, const TileSnapshot* applied);
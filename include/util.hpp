@@ -1,9 +1,22 @@
 #pragma once
 
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
 #include <allegro5/allegro.h>
 #include "vec.hpp"
 
+constexpr uint64_t HASH_SEED = 0xcbf29ce484222325ULL; // FNV-1a 64 offset basis
+
 vec2i getScreenSize();
 std::string getAllegroVersionStr();
 ALLEGRO_DISPLAY *createDisplay(std::string title, int width, int height, int flags);
-std::string getHomeDir();
\ No newline at end of file
+std::string getHomeDir();
+std::string getCacheDir();
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = HASH_SEED);
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0); // Pass the previous result to continue a checksum
+double getProcessCpuTime(); // Seconds of CPU used by every thread of the process
+bool syncFile(FILE* f); // Flushes the C buffers and then the OS ones, so the data is on disk when it returns
+void syncDirectory(const std::string& dir); // Makes a rename inside dir survive a crash
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include <allegro5/allegro_primitives.h>
 
 #include "vec.hpp"
@@ -30,5 +32,40 @@ namespace View
 	void drawBitmap(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d& tl, int flags);
 	void drawBitmapRegion(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d s_tl, const vec2d& s_dim, const vec2d& d_tl, int flags);
 	void drawScaledBitmap(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d& tl, const vec2d& scale, int flags);
+	void drawScaledBitmapRegion(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d& s_tl, const vec2d& s_dim, const vec2d& d_tl, const vec2d& d_dim, int flags);
 	void drawTintedBitmapRegion(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d s_tl, const vec2d& s_dim, const vec2d& d_tl, const ALLEGRO_COLOR& cl, int flags);
+	void drawTintedScaledBitmapRegion(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d& s_tl, const vec2d& s_dim, const vec2d& d_tl, const vec2d& d_dim, const ALLEGRO_COLOR& cl, int flags);
+
+	// Batched drawing. Shapes are added in world coordinates, drawBatch() moves
+	// every vertex to the screen in one pass and submits them with a single
+	// al_draw_prim/al_draw_indexed_prim. Clearing keeps the storage, so a batch
+	// kept across frames stops allocating once it has seen its largest frame.
+	struct QuadBatch
+	{
+		size_t count = 0;
+		std::vector<ALLEGRO_VERTEX> world;	// tl, tr, br, bl per quad
+		std::vector<ALLEGRO_VERTEX> screen;
+		std::vector<int> indices;
+	};
+
+	struct LineBatch
+	{
+		double line_width = 1.0;			// World units, never thinner than a pixel on screen
+		size_t count = 0;
+		std::vector<ALLEGRO_VERTEX> world;	// Two per line
+		std::vector<ALLEGRO_VERTEX> screen;
+		std::vector<int> indices;
+	};
+
+	void clearBatch(QuadBatch& b);
+	void clearBatch(LineBatch& b, double line_width = 1.0);
+
+	void addQuad(QuadBatch& b, const vec2d& tl, const vec2d& br, const ALLEGRO_COLOR& cl);
+	void addLine(LineBatch& b, const vec2d& v1, const vec2d& v2, const ALLEGRO_COLOR& cl);
+
+	void drawBatch(const ViewPort& v, QuadBatch& b);
+	void drawBatch(const ViewPort& v, LineBatch& b);
+	// Hairlines drawn from the world vertices with the view as a transform, nothing is copied.
+	// Lines that come out thicker than a pixel are drawn as quads by drawBatch() instead.
+	void drawBatchTransformed(const ViewPort& v, LineBatch& b);
 };
\ No newline at end of file
@@ -2,7 +2,10 @@
 
 #include <chrono>
 #include <iostream>
+#include <algorithm> // std::min, std::max
+#include <math.h> // sqrt
 #include <string>
+#include <memory>
 #include <allegro5/allegro.h>
 
 #include "vec.hpp"
@@ -11,6 +14,7 @@
 #include "view.hpp"
 #include "map.hpp"
 #include "editor_events.hpp"
+#include "live_sync.hpp"
 
 using std_clk = std::chrono::steady_clock;
 
@@ -18,19 +22,79 @@ struct ViewerArgs
 {
 	int tile_size;
 	std::string image_path;
+	std::shared_ptr<const DecodedImage> image; // The editor's decoded image, the viewer only reads the disk without it
     vec2i display_size;
     std::string display_title;
 	ALLEGRO_EVENT_SOURCE *event_source;
+	std::shared_ptr<LiveSync> live_sync; // Snapshots and live deltas from the editor
+	std_clk::time_point start_time; // When the viewer was asked for, to report the time to its first frame
+};
+
+constexpr double VIEWER_DEFAULT_REFRESH = 60.0; // When the display doesn't report its refresh rate
+constexpr int VIEWER_SYNC_REPORT_FRAMES = 120; // Live sync latency is printed every this many synced frames
+
+// Frame to frame intervals over one camera move, compared against the refresh period
+struct FramePacingStats
+{
+	int frames = 0;
+	double sum = 0.0;
+	double sum_sq = 0.0;
+	double worst = 0.0;
+
+	void add(double interval)
+	{
+		++frames;
+		sum += interval;
+		sum_sq += interval * interval;
+		worst = std::max(worst, interval);
+	}
+
+	void report(double period)
+	{
+		if (frames < 2) return;
+
+		double mean = sum / frames;
+		double jitter = sqrt(std::max(0.0, sum_sq / frames - mean * mean));
+
+		std::cout << "Viewer pacing: " << frames << " frames, mean " << mean * 1000.0 << " ms (refresh "
+			<< period * 1000.0 << " ms), jitter " << jitter * 1000.0 << " ms, worst " << worst * 1000.0 << " ms" << std::endl;
+
+		*this = FramePacingStats();
+	}
+};
+
+// Time from an edit being committed in the editor to the viewer frame showing it
+struct SyncLatencyStats
+{
+	int frames = 0;
+	uint64_t deltas = 0;
+	double sum = 0.0;
+	double worst = 0.0;
+
+	void add(double latency, int count)
+	{
+		++frames;
+		deltas += count;
+		sum += latency;
+		worst = std::max(worst, latency);
+	}
+
+	void report(uint64_t resyncs)
+	{
+		if (frames == 0) return;
+
+		std::cout << "Viewer live sync: " << deltas << " deltas over " << frames << " frames, latency mean " << sum / frames * 1000.0
+			<< " ms, worst " << worst * 1000.0 << " ms, " << resyncs << " resyncs" << std::endl;
+
+		*this = SyncLatencyStats();
+	}
 };
 
 void *viewer_thread_func(ALLEGRO_THREAD* thr, void* arg)
 {
 	ALLEGRO_DISPLAY* 		display 		= nullptr;
 	ALLEGRO_EVENT_QUEUE* 	evq 			= nullptr;
-	ALLEGRO_TIMER* 			timer 			= nullptr;
 	ALLEGRO_EVENT 			ev;
-	std_clk::time_point 	current_time;
-	double 					delta_time;
 	bool 					running 		= true;
 	bool 					redraw 			= true;
 
@@ -45,29 +109,44 @@ void *viewer_thread_func(ALLEGRO_THREAD* thr, void* arg)
 
 	bool lerping = false;
 	constexpr double lerp_time = 1.5;
-	double elapsed = 0.0;
+	std_clk::time_point lerp_start;
 	vec2d view_start;
 	vec2d view_target;
 
+	FramePacingStats pacing;
+	std_clk::time_point last_flip;
+	bool flipped_last_frame = false;
+	bool flipped_first_frame = false;
+
+	std::shared_ptr<const TileSnapshot> applied; // Last version pasted into map, bands it shares with a newer one are skipped
+	bool sync_pending = false;
+	SyncLatencyStats sync_latency;
+
+	// Flips wait for the vertical blank, so frames are paced by the display itself
+	al_set_new_display_option(ALLEGRO_VSYNC, 1, ALLEGRO_SUGGEST);
 	display = createDisplay(args->display_title.c_str(), args->display_size.x, args->display_size.y, ALLEGRO_RESIZABLE | ALLEGRO_WINDOWED);
-	timer = al_create_timer(1.0 / 60.0);
 	evq = al_create_event_queue();
 
-	al_register_event_source(evq, al_get_timer_event_source(timer));
+	int refresh = al_get_display_refresh_rate(display);
+	const double frame_period = 1.0 / (refresh > 0 ? refresh : VIEWER_DEFAULT_REFRESH);
+
 	al_register_event_source(evq, al_get_display_event_source(display));
 	al_register_event_source(evq, args->event_source);
 
-	if (!createMap(map, args->image_path, args->tile_size))
+	// Pages are uploaded to this display straight from the editor's decode, which both keep alive
+	MapImage image;
+	bool loaded = args->image ? uploadMapImage(image, args->image) && createMap(map, image, args->image_path, args->tile_size)
+		: createMap(map, args->image_path, args->tile_size);
+
+	if (!loaded)
 	{
+		destroyMapImage(image);
 		std::cerr << "Viewer failed to load bitmap!\n\tImage path: " << args->image_path << std::endl;
 		if (display) al_destroy_display(display);
-		if (timer) al_destroy_timer(timer);
 		if (evq) al_destroy_event_queue(evq);
 		return NULL;
 	}
 
-	al_start_timer(timer);
-	auto last_time = std_clk::now();
 	while (running)
 	{
 		if (al_get_thread_should_stop(thr))
@@ -75,50 +154,47 @@ void *viewer_thread_func(ALLEGRO_THREAD* thr, void* arg)
 			break;
 		}
 
-		al_wait_for_event(evq, &ev);
-	
+		// Sleep until something happens, unless the camera is moving
+		if (!lerping && !redraw)
+		{
+			al_wait_for_event(evq, &ev);
+		}
+		else if (!al_get_next_event(evq, &ev))
+		{
+			ev.type = 0;
+		}
+
 		vec2d diff;
-		Map *t_map;
 		switch (ev.type)
 		{
 			case AXE_EDITOR_EVENT_SHOWHIDE_GRID:
 				grid = !grid;
+				redraw = true;
 			break;
 
-			case AXE_EDITOR_EVENT_COPY_DATA:
-				t_map = reinterpret_cast<Map*>(ev.user.data1);
-				map.v_tiles = t_map->v_tiles;
-				t_map = nullptr; // DO NOT CACHE ev.user.data1!
+			// Both are taken once per frame, however many queued up
+			case AXE_EDITOR_EVENT_COPY_DATA: // Fall through
+			case AXE_EDITOR_EVENT_LIVE_SYNC:
+				sync_pending = true;
+				redraw = true;
 			break;
 
 			case AXE_EDITOR_EVENT_MOVE_VIEW:
 				view_target.x = static_cast<double>(ev.user.data1);
 				view_target.y = static_cast<double>(ev.user.data2);
 				view_start = view.world_pos;
+				lerp_start = std_clk::now();
 				lerping = true;
-				elapsed = 0.0;
 			break;
 
 			case AXE_EDITOR_EVENT_ZOOM_IN:
 				if (view.scale < 5.0) view.scale += 0.1;
+				redraw = true;
 			break;
 
 			case AXE_EDITOR_EVENT_ZOOM_OUT:
 				if (view.scale >= 0.2) view.scale -= 0.1;
-			break;
-
-			case ALLEGRO_EVENT_TIMER:
-				current_time = std_clk::now();
-				delta_time = std::chrono::duration<double>(current_time - last_time).count();
-				last_time = current_time;
 				redraw = true;
-
-				if (lerping && elapsed <= lerp_time)
-				{
-					elapsed += delta_time;
-					view.world_pos = vec_lerp(view_start, view_target, easeInAndOutQuart(elapsed / lerp_time));
-				}
-				else lerping = false;
 			break;
 
 			case ALLEGRO_EVENT_DISPLAY_CLOSE:
@@ -128,26 +204,76 @@ void *viewer_thread_func(ALLEGRO_THREAD* thr, void* arg)
 			case ALLEGRO_EVENT_DISPLAY_RESIZE:
 				al_acknowledge_resize(display);
 				view.size = { al_get_display_width(display), al_get_display_height(display) };
+				redraw = true;
+			break;
+
+			case ALLEGRO_EVENT_DISPLAY_EXPOSE:
+				redraw = true;
 			break;
 
 			default:
 			break;
 		}
 
-		if (al_event_queue_is_empty(evq) && redraw)
+		if (!al_event_queue_is_empty(evq) || !(redraw || lerping)) continue;
+
+		if (lerping)
 		{
-			al_clear_to_color(al_map_rgb(0, 0, 0));
+			// Camera position for when this frame reaches the screen, one refresh after the last one did
+			std_clk::time_point present = flipped_last_frame ? last_flip + std::chrono::duration_cast<std_clk::duration>(std::chrono::duration<double>(frame_period)) : std_clk::now();
+			double t = std::chrono::duration<double>(present - lerp_start).count() / lerp_time;
 
-			drawMap(map, view, grid, false);
+			view.world_pos = vec_lerp(view_start, view_target, easeInAndOutQuart(std::min(t, 1.0)));
+			if (t >= 1.0) lerping = false;
+		}
 
-			al_flip_display();
-			redraw = false;
+		int synced = 0;
+		std_clk::time_point sync_oldest;
+		if (sync_pending)
+		{
+			synced = args->live_sync->receive(map, applied, sync_oldest);
+			sync_pending = false;
+		}
+
+		al_clear_to_color(al_map_rgb(0, 0, 0));
+
+		drawMap(map, view, grid, false);
+
+		al_flip_display();
+
+		std_clk::time_point now = std_clk::now();
+		if (synced > 0)
+		{
+			sync_latency.add(std::chrono::duration<double>(now - sync_oldest).count(), synced);
+			if (sync_latency.frames >= VIEWER_SYNC_REPORT_FRAMES) sync_latency.report(args->live_sync->getResyncs());
 		}
+		if (!flipped_first_frame)
+		{
+			std::cout << "Viewer first frame: " << std::chrono::duration<double, std::milli>(now - args->start_time).count() << " ms ("
+				<< (args->image ? "shared decode" : "loaded from disk") << ")" << std::endl;
+			flipped_first_frame = true;
+		}
+		double interval = std::chrono::duration<double>(now - last_flip).count();
+
+		// Without vsync the flip returns straight away, so wait out the rest of the refresh period
+		if (flipped_last_frame && interval < frame_period * 0.5)
+		{
+			al_rest(frame_period - interval);
+			now = std_clk::now();
+			interval = std::chrono::duration<double>(now - last_flip).count();
+		}
+
+		if (flipped_last_frame) pacing.add(interval);
+		if (!lerping) pacing.report(frame_period);
+
+		flipped_last_frame = lerping;
+		last_flip = now;
+		redraw = false;
 	}
 
+	sync_latency.report(args->live_sync->getResyncs());
 	destroyMap(map);
 
-	al_destroy_timer(timer);
 	al_destroy_event_queue(evq);
 	al_destroy_display(display);
 
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include "map.hpp"
+#include "tile_snapshot.hpp"
+
+// The visibility after every step of the undo history. Each step is a TileSnapshot
+// sharing the bands its edit didn't touch with the step before, so taking one costs
+// the touched bands, going back to any step pastes the bands that differ, and a step
+// can be handed to another thread as it is.
+class VisibilityHistory
+{
+public:
+	void reset(const Map& m); // A single step, m as it is now
+	void commit(const Map& m); // Drops the steps after the cursor and adds m as the newest
+	void dropOldest();
+
+	void setCursor(size_t index) { cursor = index; } // The map was moved to that step
+	size_t getCursor() const { return cursor; }
+	size_t size() const { return steps.size(); }
+
+	std::shared_ptr<const TileSnapshot> at(size_t index) const { return steps[index].tiles; }
+	std::shared_ptr<const TileSnapshot> current() const { return steps.empty() ? nullptr : steps[cursor].tiles; }
+
+	size_t getSize() const { return bytes; } // Bands held, each counted once
+
+private:
+	struct Step
+	{
+		std::shared_ptr<const TileSnapshot> tiles;
+		uint64_t stamp; // Map edit stamp when it was taken, rows stamped later are copied for the next step
+	};
+
+	std::deque<Step> steps;
+	size_t cursor = 0;
+	size_t bytes = 0;
+};
@@ -0,0 +1,181 @@
+#include "autosave.hpp"
+#include "mdf.hpp"
+#include "thread_pool.hpp"
+
+#include <iostream>
+#include <algorithm> // std::sort, std::max
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip> // std::setw
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+using std_clk = std::chrono::steady_clock;
+
+constexpr char AUTOSAVE_PREFIX[] = "autosave-";
+constexpr char AUTOSAVE_EXT[] = ".mdf";
+
+struct Autosaver::State
+{
+	std::string dir;
+	std::atomic<int> generations{AUTOSAVE_DEFAULT_GENERATIONS};
+	std::atomic<bool> writing{false};
+
+	uint64_t next_sequence = 0;		// Worker only, found by scanning dir before the first write
+	bool scanned = false;
+
+	mutable std::mutex stats_mutex;
+	AutosaveStats stats;
+};
+
+static double secondsSince(std_clk::time_point start)
+{
+	return std::chrono::duration<double>(std_clk::now() - start).count();
+}
+
+// Sequence number of an autosave file name, or -1 for anything else in the directory
+static int64_t getAutosaveSequence(const fs::path& file)
+{
+	std::string name = file.filename().string();
+	const size_t prefix = sizeof(AUTOSAVE_PREFIX) - 1;
+	const size_t ext = sizeof(AUTOSAVE_EXT) - 1;
+
+	if (name.size() <= prefix + ext || name.compare(0, prefix, AUTOSAVE_PREFIX) != 0 || name.compare(name.size() - ext, ext, AUTOSAVE_EXT) != 0) return -1;
+
+	int64_t seq = 0;
+	for (size_t i = prefix; i < name.size() - ext; ++i)
+	{
+		if (name[i] < '0' || name[i] > '9') return -1;
+		seq = seq * 10 + (name[i] - '0');
+	}
+
+	return seq;
+}
+
+static std::vector<std::pair<int64_t, fs::path>> listAutosaves(const std::string& dir)
+{
+	std::vector<std::pair<int64_t, fs::path>> files;
+	std::error_code ec;
+
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+	{
+		int64_t seq = getAutosaveSequence(it->path());
+		if (seq >= 0) files.emplace_back(seq, it->path());
+	}
+
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+static void writeAutosave(Autosaver::State& s, const MapFileInfo& info, const TileBitset& tiles)
+{
+	auto start = std_clk::now();
+	std::error_code ec;
+	fs::create_directories(s.dir, ec);
+
+	if (!s.scanned)
+	{
+		auto files = listAutosaves(s.dir);
+		s.next_sequence = files.empty() ? 0 : files.back().first + 1;
+		s.scanned = true;
+	}
+
+	std::stringstream name;
+	name << AUTOSAVE_PREFIX << std::setw(6) << std::setfill('0') << s.next_sequence++ << AUTOSAVE_EXT;
+	std::string file = (fs::path(s.dir) / name.str()).string();
+
+	bool ok = writeMapFile(file, info, tiles);
+
+	// Oldest first, so everything before the last n goes
+	if (ok)
+	{
+		auto files = listAutosaves(s.dir);
+		size_t keep = static_cast<size_t>(std::max(1, s.generations.load()));
+		for (size_t i = 0; i + keep < files.size(); ++i) fs::remove(files[i].second, ec);
+	}
+
+	std::lock_guard<std::mutex> lock(s.stats_mutex);
+	if (ok)
+	{
+		++s.stats.saves;
+		s.stats.last_file = file;
+	}
+	else
+	{
+		++s.stats.failures;
+		std::cerr << "Autosave failed: " << file << std::endl;
+	}
+	s.stats.write_time = secondsSince(start);
+}
+
+Autosaver::Autosaver(const std::string& dir) : state(std::make_shared<State>())
+{
+	state->dir = dir;
+}
+
+void Autosaver::setGenerations(int generations)
+{
+	state->generations = std::max(1, generations);
+}
+
+int Autosaver::getGenerations() const
+{
+	return state->generations;
+}
+
+bool Autosaver::save(const Map& m, std::shared_ptr<const TileSnapshot> tiles, const View::ViewPort& v)
+{
+	if (!tiles || tiles->blocks.empty()) return false;
+
+	bool unchanged = m.path == saved_path && tiles == saved_tiles && v.world_pos.x == saved_view_pos.x &&
+		v.world_pos.y == saved_view_pos.y && v.scale == saved_view_scale;
+	if (unchanged) return false;
+
+	if (state->writing.exchange(true))
+	{
+		std::lock_guard<std::mutex> lock(state->stats_mutex);
+		++state->stats.skipped;
+		return false;
+	}
+
+	// The snapshot is shared with the editor's history, only a few fields are copied here
+	auto start = std_clk::now();
+
+	MapFileInfo info;
+	info.image_path = m.path;
+	info.width = m.width;
+	info.height = m.height;
+	info.tile_size = m.tile_size;
+	info.view_pos = v.world_pos;
+	info.view_scale = v.scale;
+
+	double capture_time = secondsSince(start);
+
+	{
+		std::lock_guard<std::mutex> lock(state->stats_mutex);
+		state->stats.capture_time = capture_time;
+	}
+
+	saved_path = m.path;
+	saved_tiles = tiles;
+	saved_view_pos = v.world_pos;
+	saved_view_scale = v.scale;
+
+	std::shared_ptr<State> s = state;
+	getWorkerPool().submit([s, info, tiles]()
+	{
+		writeAutosave(*s, info, flattenTileSnapshot(*tiles));
+		s->writing = false;
+	});
+
+	return true;
+}
+
+AutosaveStats Autosaver::getStats() const
+{
+	std::lock_guard<std::mutex> lock(state->stats_mutex);
+	return state->stats;
+}
@@ -0,0 +1,492 @@
+#include "bundle.hpp"
+#include "byte_io.hpp"
+#include "util.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <sstream>
+#include <iomanip> // std::setw
+#include <algorithm> // std::find_if
+#include <cstdio> // FILE
+#include <cstring> // memcmp
+
+#include <allegro5/allegro.h>
+
+namespace fs = std::filesystem;
+
+constexpr uint8_t BUNDLE_MAGIC[3] = {'A', 'X', 'B'};
+constexpr size_t BUNDLE_HEADER_SIZE = 32;
+constexpr uint64_t BUNDLE_ALIGN = 4096; // Level data starts on a page boundary so it can be mapped directly
+constexpr char BUNDLE_REF_TAG[] = "#axb:";
+constexpr size_t BUNDLE_REF_HASH_DIGITS = 16;
+constexpr int BUNDLE_MAX_SIDE = 1 << 20;
+
+std::string makeBundleImagePath(const std::string& bundle_path, uint64_t hash)
+{
+	std::stringstream ss;
+	ss << bundle_path << BUNDLE_REF_TAG << std::hex << std::setw(BUNDLE_REF_HASH_DIGITS) << std::setfill('0') << hash;
+	return ss.str();
+}
+
+bool parseBundleImagePath(const std::string& path, std::string& bundle_path, uint64_t& hash)
+{
+	const size_t tag_len = sizeof(BUNDLE_REF_TAG) - 1;
+	if (path.size() < tag_len + BUNDLE_REF_HASH_DIGITS) return false;
+
+	size_t tag = path.size() - BUNDLE_REF_HASH_DIGITS - tag_len;
+	if (path.compare(tag, tag_len, BUNDLE_REF_TAG) != 0) return false;
+
+	hash = 0;
+	for (size_t i = tag + tag_len; i < path.size(); ++i)
+	{
+		char c = path[i];
+		int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+		if (digit < 0) return false;
+		hash = (hash << 4) | static_cast<uint64_t>(digit);
+	}
+
+	bundle_path = path.substr(0, tag);
+	return true;
+}
+
+bool isBundleImagePath(const std::string& path)
+{
+	std::string bundle_path;
+	uint64_t hash;
+	return parseBundleImagePath(path, bundle_path, hash);
+}
+
+static bool inFile(uint64_t offset, uint64_t size, size_t file_size)
+{
+	return offset <= file_size && size <= file_size - offset;
+}
+
+bool openBundle(Bundle& b, const std::string& path)
+{
+	closeBundle(b);
+
+	auto file = std::make_shared<MappedFile>();
+	if (!file->open(path)) return false;
+
+	const uint8_t* data = file->data();
+	const size_t size = file->size();
+
+	ByteReader header(data, size);
+	const uint8_t* magic = header.bytes(3);
+	uint16_t version = header.u16();
+	header.bytes(3);
+	uint64_t toc_offset = header.u64();
+	uint64_t toc_size = header.u64();
+	uint32_t toc_crc = header.u32();
+	uint32_t header_crc = header.u32();
+
+	if (!header.ok || memcmp(magic, BUNDLE_MAGIC, 3) != 0 || version != BUNDLE_VERSION || crc32(data, 28) != header_crc)
+	{
+		std::cerr << "Not a campaign bundle: " << path << std::endl;
+		return false;
+	}
+
+	if (!inFile(toc_offset, toc_size, size) || crc32(data + toc_offset, static_cast<size_t>(toc_size)) != toc_crc)
+	{
+		std::cerr << "Campaign bundle table of contents is damaged: " << path << std::endl;
+		return false;
+	}
+
+	ByteReader toc(data + toc_offset, static_cast<size_t>(toc_size));
+	bool ok = true;
+
+	uint32_t image_count = toc.u32();
+	for (uint32_t i = 0; i < image_count && toc.ok && ok; ++i)
+	{
+		BundleImage img;
+		img.hash = toc.u64();
+		uint8_t ext_len = toc.u8();
+		const uint8_t* ext = toc.bytes(ext_len);
+		if (ext) img.ext.assign(reinterpret_cast<const char*>(ext), ext_len);
+		img.source_offset = toc.u64();
+		img.source_size = toc.u64();
+		ok = inFile(img.source_offset, img.source_size, size);
+
+		uint32_t level_count = toc.u32();
+		if (level_count > MAP_IMAGE_MAX_LEVELS) ok = false;
+
+		for (uint32_t l = 0; l < level_count && toc.ok && ok; ++l)
+		{
+			BundleLevel level;
+			level.width = static_cast<int>(toc.u32());
+			level.height = static_cast<int>(toc.u32());
+			level.offset = toc.u64();
+
+			ok = level.width > 0 && level.height > 0 && level.width <= BUNDLE_MAX_SIDE && level.height <= BUNDLE_MAX_SIDE &&
+				inFile(level.offset, static_cast<uint64_t>(level.width) * level.height * 4, size);
+			img.levels.push_back(level);
+		}
+
+		b.images.push_back(std::move(img));
+	}
+
+	uint32_t map_count = toc.u32();
+	for (uint32_t i = 0; i < map_count && toc.ok && ok; ++i)
+	{
+		BundleMap m;
+		uint16_t name_len = toc.u16();
+		const uint8_t* name = toc.bytes(name_len);
+		if (name) m.name.assign(reinterpret_cast<const char*>(name), name_len);
+		m.image_hash = toc.u64();
+		m.offset = toc.u64();
+		m.size = toc.u64();
+
+		ok = inFile(m.offset, m.size, size) && findBundleImage(b, m.image_hash);
+		b.maps.push_back(std::move(m));
+	}
+
+	if (!toc.ok || !ok)
+	{
+		std::cerr << "Campaign bundle table of contents is damaged: " << path << std::endl;
+		closeBundle(b);
+		return false;
+	}
+
+	b.path = path;
+	b.file = file;
+
+	return true;
+}
+
+void closeBundle(Bundle& b)
+{
+	b.path.clear();
+	b.file.reset();
+	b.images.clear();
+	b.maps.clear();
+}
+
+const BundleImage* findBundleImage(const Bundle& b, uint64_t hash)
+{
+	auto it = std::find_if(b.images.begin(), b.images.end(), [hash](const BundleImage& img) { return img.hash == hash; });
+	return it != b.images.end() ? &*it : nullptr;
+}
+
+const BundleMap* findBundleMap(const Bundle& b, const std::string& name)
+{
+	auto it = std::find_if(b.maps.begin(), b.maps.end(), [&name](const BundleMap& m) { return m.name == name; });
+	return it != b.maps.end() ? &*it : nullptr;
+}
+
+bool readBundleMap(const Bundle& b, const std::string& name, MapFileInfo& info, TileBitset& tiles)
+{
+	const BundleMap* m = b.file ? findBundleMap(b, name) : nullptr;
+	if (!m)
+	{
+		std::cerr << "No map named " << name << " in campaign bundle: " << b.path << std::endl;
+		return false;
+	}
+
+	if (!readMapData(b.file->data() + m->offset, static_cast<size_t>(m->size), info, tiles))
+	{
+		std::cerr << "Failed to load map " << name << " from campaign bundle: " << b.path << std::endl;
+		return false;
+	}
+
+	info.image_path = makeBundleImagePath(b.path, m->image_hash);
+
+	return true;
+}
+
+bool loadBundleImage(DecodedImage& img, const std::string& image_path, bool& has_levels)
+{
+	std::string bundle_path;
+	uint64_t hash = 0;
+	Bundle b;
+
+	if (!parseBundleImagePath(image_path, bundle_path, hash) || !openBundle(b, bundle_path)) return false;
+
+	const BundleImage* entry = findBundleImage(b, hash);
+	if (!entry)
+	{
+		std::cerr << "Image is missing from campaign bundle: " << image_path << std::endl;
+		return false;
+	}
+
+	img.levels.clear();
+	img.mapping.reset();
+
+	// Pre-decoded pyramids are used in place, only the pages that get uploaded are ever read
+	if (!entry->levels.empty())
+	{
+		for (const BundleLevel& bl : entry->levels)
+		{
+			ImageLevel level;
+			level.width = bl.width;
+			level.height = bl.height;
+			level.mapped = b.file->data() + bl.offset;
+			img.levels.push_back(std::move(level));
+		}
+
+		img.mapping = b.file;
+		has_levels = true;
+		return true;
+	}
+
+	if (entry->source_size == 0 || hashBytes(b.file->data() + entry->source_offset, static_cast<size_t>(entry->source_size)) != hash)
+	{
+		std::cerr << "Image in campaign bundle is damaged: " << image_path << std::endl;
+		return false;
+	}
+
+	// Allegro decodes the embedded file through a slice of the bundle
+	ALLEGRO_FILE* f = al_fopen(bundle_path.c_str(), "rb");
+	if (!f) return false;
+
+	bool ok = false;
+	if (al_fseek(f, static_cast<int64_t>(entry->source_offset), ALLEGRO_SEEK_SET))
+	{
+		ALLEGRO_FILE* slice = al_fopen_slice(f, static_cast<size_t>(entry->source_size), "rb");
+		if (slice)
+		{
+			ok = decodeImage(img, slice, "." + entry->ext);
+			al_fclose(slice);
+		}
+	}
+	al_fclose(f);
+
+	has_levels = false;
+	return ok;
+}
+
+// An image on its way into the new bundle, pointing into whatever keeps its bytes alive
+struct PendingImage
+{
+	BundleImage entry;
+	const uint8_t* source = nullptr;
+	std::vector<const uint8_t*> level_data;
+	std::shared_ptr<const void> keep_alive;
+};
+
+static PendingImage pendingFromBundle(const Bundle& b, const BundleImage& img)
+{
+	PendingImage p;
+	p.entry = img;
+	p.source = img.source_size ? b.file->data() + img.source_offset : nullptr;
+	for (const BundleLevel& level : img.levels) p.level_data.push_back(b.file->data() + level.offset);
+	p.keep_alive = b.file;
+	return p;
+}
+
+static bool writeAll(FILE* f, const void* data, size_t size, uint64_t& offset)
+{
+	offset += size;
+	return fwrite(data, 1, size, f) == size;
+}
+
+static bool padTo(FILE* f, uint64_t align, uint64_t& offset)
+{
+	static const uint8_t zeros[BUNDLE_ALIGN] = {};
+	uint64_t pad = (align - offset % align) % align;
+	return writeAll(f, zeros, static_cast<size_t>(pad), offset);
+}
+
+bool writeBundleMap(const std::string& path, const std::string& name, const MapFileInfo& info, const TileBitset& tiles, bool embed_decoded)
+{
+	if (name.empty() || name.size() > UINT16_MAX) return false;
+
+	// Never replace a bundle we can't read, it may hold maps that would be lost
+	Bundle old;
+	std::error_code ec;
+	if (fs::exists(path, ec) && !openBundle(old, path)) return false;
+
+	std::vector<PendingImage> images;
+	std::vector<BundleMap> maps;
+	std::vector<std::vector<uint8_t>> map_data;
+
+	for (const BundleMap& m : old.maps)
+	{
+		if (m.name == name) continue;
+		maps.push_back(m);
+		map_data.emplace_back(old.file->data() + m.offset, old.file->data() + m.offset + m.size);
+	}
+
+	// The new map's image, from another bundle or read from disk and hashed
+	PendingImage image;
+	Bundle source_bundle;
+	std::string source_bundle_path;
+
+	if (parseBundleImagePath(info.image_path, source_bundle_path, image.entry.hash))
+	{
+		const BundleImage* found = findBundleImage(old, image.entry.hash);
+		if (!found)
+		{
+			if (!openBundle(source_bundle, source_bundle_path)) return false;
+			found = findBundleImage(source_bundle, image.entry.hash);
+			if (!found) return false;
+			image = pendingFromBundle(source_bundle, *found);
+		}
+	}
+	else
+	{
+		auto file = std::make_shared<MappedFile>();
+		if (!file->open(info.image_path))
+		{
+			std::cerr << "Failed to read map image for campaign bundle: " << info.image_path << std::endl;
+			return false;
+		}
+
+		image.entry.hash = hashBytes(file->data(), file->size());
+		image.entry.ext = fs::path(info.image_path).extension().string();
+		if (!image.entry.ext.empty() && image.entry.ext[0] == '.') image.entry.ext.erase(0, 1);
+		image.entry.source_size = file->size();
+		image.source = file->data();
+		image.keep_alive = file;
+	}
+
+	// Keep every image a map still uses, the first copy of each content wins
+	auto add_image = [&images](PendingImage p)
+	{
+		for (PendingImage& existing : images)
+		{
+			if (existing.entry.hash == p.entry.hash) return;
+		}
+		images.push_back(std::move(p));
+	};
+
+	for (const BundleMap& m : maps) add_image(pendingFromBundle(old, *findBundleImage(old, m.image_hash)));
+	if (const BundleImage* found = findBundleImage(old, image.entry.hash)) add_image(pendingFromBundle(old, *found));
+	else add_image(image);
+
+	BundleMap new_map;
+	new_map.name = name;
+	new_map.image_hash = image.entry.hash;
+
+	// The embedded MDF only keeps the image's file name, the bundle is what points at it
+	MapFileInfo embedded_info = info;
+	embedded_info.image_path = isBundleImagePath(info.image_path) ? "" : fs::path(info.image_path).filename().string();
+
+	map_data.emplace_back();
+	if (!writeMapData(embedded_info, tiles, map_data.back())) return false;
+	maps.push_back(new_map);
+
+	if (embed_decoded)
+	{
+		for (PendingImage& p : images)
+		{
+			if (p.entry.hash != image.entry.hash || !p.entry.levels.empty()) continue;
+
+			auto decoded = std::make_shared<DecodedImage>();
+			if (!loadDecodedImage(*decoded, info.image_path)) return false;
+
+			p.entry.levels.clear();
+			p.level_data.clear();
+			for (const ImageLevel& level : decoded->levels)
+			{
+				p.entry.levels.push_back(BundleLevel{level.width, level.height, 0});
+				p.level_data.push_back(level.data());
+			}
+
+			// Keeps both the pixels and the bundle or source file the entry already points into
+			auto previous = p.keep_alive;
+			p.keep_alive = std::make_shared<std::pair<std::shared_ptr<const void>, std::shared_ptr<DecodedImage>>>(previous, decoded);
+		}
+	}
+
+	// Written next to the old bundle and renamed over it, so a crash leaves one or the other
+	const std::string temp = path + ".tmp";
+	FILE* out = fopen(temp.c_str(), "wb");
+	if (!out)
+	{
+		std::cerr << "Failed to open campaign bundle for writing: " << temp << std::endl;
+		return false;
+	}
+
+	uint64_t offset = 0;
+	uint8_t header[BUNDLE_HEADER_SIZE] = {};
+	bool ok = writeAll(out, header, sizeof(header), offset);
+
+	for (PendingImage& p : images)
+	{
+		if (p.source)
+		{
+			p.entry.source_offset = offset;
+			ok = ok && writeAll(out, p.source, static_cast<size_t>(p.entry.source_size), offset);
+		}
+		else
+		{
+			p.entry.source_offset = 0;
+			p.entry.source_size = 0;
+		}
+
+		for (size_t l = 0; l < p.entry.levels.size(); ++l)
+		{
+			BundleLevel& level = p.entry.levels[l];
+			ok = ok && padTo(out, BUNDLE_ALIGN, offset);
+			level.offset = offset;
+			ok = ok && writeAll(out, p.level_data[l], static_cast<size_t>(level.width) * level.height * 4, offset);
+		}
+	}
+
+	for (size_t i = 0; i < maps.size(); ++i)
+	{
+		maps[i].offset = offset;
+		maps[i].size = map_data[i].size();
+		ok = ok && writeAll(out, map_data[i].data(), map_data[i].size(), offset);
+	}
+
+	ByteWriter toc;
+	toc.u32(static_cast<uint32_t>(images.size()));
+	for (const PendingImage& p : images)
+	{
+		toc.u64(p.entry.hash);
+		toc.u8(static_cast<uint8_t>(std::min<size_t>(p.entry.ext.size(), UINT8_MAX)));
+		toc.bytes(p.entry.ext.data(), std::min<size_t>(p.entry.ext.size(), UINT8_MAX));
+		toc.u64(p.entry.source_offset);
+		toc.u64(p.entry.source_size);
+		toc.u32(static_cast<uint32_t>(p.entry.levels.size()));
+		for (const BundleLevel& level : p.entry.levels)
+		{
+			toc.u32(static_cast<uint32_t>(level.width));
+			toc.u32(static_cast<uint32_t>(level.height));
+			toc.u64(level.offset);
+		}
+	}
+	toc.u32(static_cast<uint32_t>(maps.size()));
+	for (const BundleMap& m : maps)
+	{
+		toc.u16(static_cast<uint16_t>(m.name.size()));
+		toc.bytes(m.name.data(), m.name.size());
+		toc.u64(m.image_hash);
+		toc.u64(m.offset);
+		toc.u64(m.size);
+	}
+
+	const uint64_t toc_offset = offset;
+	ok = ok && writeAll(out, toc.buf.data(), toc.buf.size(), offset);
+
+	ByteWriter head;
+	head.bytes(BUNDLE_MAGIC, 3);
+	head.u16(BUNDLE_VERSION);
+	head.buf.resize(8, 0);
+	head.u64(toc_offset);
+	head.u64(toc.buf.size());
+	head.u32(crc32(toc.buf.data(), toc.buf.size()));
+	head.u32(crc32(head.buf.data(), 28));
+
+	ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(head.buf.data(), 1, head.buf.size(), out) == head.buf.size() && syncFile(out);
+	ok = fclose(out) == 0 && ok;
+
+	// Let go of the old bundle before replacing it, Windows won't rename over a mapped file
+	images.clear();
+	closeBundle(old);
+	closeBundle(source_bundle);
+
+	if (ok) fs::rename(temp, path, ec);
+
+	if (!ok || ec)
+	{
+		std::cerr << "Failed to write campaign bundle: " << path << std::endl;
+		fs::remove(temp, ec);
+		return false;
+	}
+
+	syncDirectory(fs::path(path).parent_path().string());
+
+	return true;
+}
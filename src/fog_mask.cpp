@@ -0,0 +1,161 @@
+#include "fog_mask.hpp"
+#include "map_image.hpp" // getMapImagePageSize
+
+#include <iostream>
+#include <algorithm> // std::min, std::max
+
+constexpr uint32_t FOG_HIDDEN = 0xFFFFFFFF;
+constexpr uint32_t FOG_SHOWN = 0x00000000;
+
+static ALLEGRO_BITMAP* createFogPage(int w, int h)
+{
+	int old_flags = al_get_new_bitmap_flags();
+
+	// No linear filtering, tile edges stay sharp when the mask is scaled up
+	al_set_new_bitmap_flags(al_get_current_display() ? ALLEGRO_VIDEO_BITMAP : ALLEGRO_MEMORY_BITMAP);
+	ALLEGRO_BITMAP* page = al_create_bitmap(w, h);
+	al_set_new_bitmap_flags(old_flags);
+
+	return page;
+}
+
+// Writes tile rows [y0, y0 + n) into the page whose top left tile is (x0, page_y0)
+static bool writeFogRows(ALLEGRO_BITMAP* page, const TileBitset& tiles, int x0, int page_y0, int y0, int n)
+{
+	int w = al_get_bitmap_width(page);
+	ALLEGRO_LOCKED_REGION* lr = al_lock_bitmap_region(page, 0, y0 - page_y0, w, n, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+	if (!lr) return false;
+
+	for (int i = 0; i < n; ++i)
+	{
+		uint32_t* out = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(lr->data) + static_cast<ptrdiff_t>(i) * lr->pitch);
+		int y = y0 + i;
+
+		for (int x = 0; x < w; ++x) out[x] = tiles.test(x0 + x, y) ? FOG_SHOWN : FOG_HIDDEN;
+	}
+
+	al_unlock_bitmap(page);
+
+	return true;
+}
+
+static bool layoutFogMask(FogMask& mask, int width, int height)
+{
+	destroyFogMask(mask);
+
+	if (width <= 0 || height <= 0) return false;
+
+	mask.width = width;
+	mask.height = height;
+	mask.page_size = getMapImagePageSize();
+	mask.cols = (width + mask.page_size - 1) / mask.page_size;
+	mask.rows = (height + mask.page_size - 1) / mask.page_size;
+	mask.pages.assign(static_cast<size_t>(mask.cols) * mask.rows, nullptr);
+
+	for (int r = 0; r < mask.rows; ++r)
+	{
+		for (int c = 0; c < mask.cols; ++c)
+		{
+			ALLEGRO_BITMAP* page = createFogPage(std::min(mask.page_size, width - c * mask.page_size), std::min(mask.page_size, height - r * mask.page_size));
+
+			if (!page)
+			{
+				std::cerr << "Failed to create fog mask page " << c << ", " << r << std::endl;
+				destroyFogMask(mask);
+				return false;
+			}
+
+			mask.pages[r * mask.cols + c] = page;
+		}
+	}
+
+	return true;
+}
+
+bool updateFogMask(FogMask& mask, const TileBitset& tiles, const std::vector<uint64_t>& row_stamps, uint64_t edit_stamp)
+{
+	bool rebuild = mask.pages.empty() || mask.width != tiles.width() || mask.height != tiles.height();
+
+	if (!rebuild && mask.stamp == edit_stamp) return true;
+	if (rebuild && !layoutFogMask(mask, tiles.width(), tiles.height())) return false;
+
+	auto dirty = [&](int y) { return rebuild || static_cast<size_t>(y) >= row_stamps.size() || row_stamps[y] > mask.stamp; };
+
+	// Dirty rows are written in runs, each run split at page boundaries
+	int y = 0;
+	while (y < mask.height)
+	{
+		if (!dirty(y)) { ++y; continue; }
+
+		int end = y + 1;
+		while (end < mask.height && dirty(end) && end % mask.page_size != 0) ++end;
+
+		int r = y / mask.page_size;
+		for (int c = 0; c < mask.cols; ++c)
+		{
+			if (!writeFogRows(mask.pages[r * mask.cols + c], tiles, c * mask.page_size, r * mask.page_size, y, end - y))
+			{
+				std::cerr << "Failed to lock fog mask page " << c << ", " << r << std::endl;
+				destroyFogMask(mask);
+				return false;
+			}
+		}
+
+		y = end;
+	}
+
+	mask.stamp = edit_stamp;
+
+	return true;
+}
+
+void destroyFogMask(FogMask& mask)
+{
+	for (ALLEGRO_BITMAP* page : mask.pages)
+	{
+		if (page) al_destroy_bitmap(page);
+	}
+
+	mask.pages.clear();
+	mask.width = 0;
+	mask.height = 0;
+	mask.page_size = 0;
+	mask.cols = 0;
+	mask.rows = 0;
+	mask.stamp = 0;
+}
+
+bool isFogMaskReady(const FogMask& mask)
+{
+	return !mask.pages.empty();
+}
+
+void drawFogMask(const FogMask& mask, const View::ViewPort& v, int tile_size, const vec2i& tl, const vec2i& br, const ALLEGRO_COLOR& fog)
+{
+	if (mask.pages.empty() || tl.x > br.x || tl.y > br.y) return;
+
+	int c0 = std::max(0, tl.x / mask.page_size);
+	int r0 = std::max(0, tl.y / mask.page_size);
+	int c1 = std::min(mask.cols - 1, br.x / mask.page_size);
+	int r1 = std::min(mask.rows - 1, br.y / mask.page_size);
+
+	al_hold_bitmap_drawing(true);
+
+	for (int r = r0; r <= r1; ++r)
+	{
+		for (int c = c0; c <= c1; ++c)
+		{
+			ALLEGRO_BITMAP* page = mask.pages[r * mask.cols + c];
+
+			// Part of the page inside the tile rect, in tiles
+			vec2i p_tl(c * mask.page_size, r * mask.page_size);
+			vec2i d_tl(std::max(p_tl.x, tl.x), std::max(p_tl.y, tl.y));
+			vec2i d_br(std::min(p_tl.x + al_get_bitmap_width(page) - 1, br.x), std::min(p_tl.y + al_get_bitmap_height(page) - 1, br.y));
+			vec2i dim = d_br - d_tl + vec2i(1, 1);
+
+			View::drawTintedScaledBitmapRegion(v, page, vec2d(d_tl - p_tl), vec2d(dim), vec2d(d_tl * tile_size), vec2d(dim * tile_size), fog, 0);
+		}
+	}
+
+	al_hold_bitmap_drawing(false);
+}
@@ -1,9 +1,14 @@
 #include "gui.hpp"
+#include "autosave.hpp"
+#include "command.hpp"
 #include <iostream>
 
 char Gui::load_file_buffer[256] = {0};
 
-Gui::Gui(ALLEGRO_DISPLAY *display) : m_display(display), m_show_demo_window(false), m_tile_size(64)
+Gui::Gui(ALLEGRO_DISPLAY *display) : m_display(display), m_show_demo_window(false), m_tile_size(64), m_importing(false), m_import_progress(0.0f), m_texture_budget_mb(static_cast<int>(TEXTURE_BUDGET_DEFAULT >> 20)), m_fog_mask(true), m_render_cache(true), m_live_sync(false),
+    m_embed_decoded(false), m_wakeups_per_sec(0.0), m_frames_per_sec(0.0), m_cpu_percent(0.0),
+    m_autosave_interval(AUTOSAVE_DEFAULT_INTERVAL), m_autosave_generations(AUTOSAVE_DEFAULT_GENERATIONS), m_autosave_capture_ms(0.0), m_autosave_write_ms(0.0), m_autosaves(0),
+    m_undo_budget_mb(static_cast<int>(UNDO_HISTORY_DEFAULT_BUDGET >> 20)), m_undo_bytes(0), m_undo_steps(0), m_history_cursor(0)
 {
     IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -25,6 +30,49 @@ void Gui::setFileBufferText(std::string path)
     strcpy(Gui::load_file_buffer, path.c_str());
 }
 
+void Gui::setImportStatus(bool importing, float progress, const std::string& stage)
+{
+    m_importing = importing;
+    m_import_progress = progress;
+    m_import_stage = stage;
+}
+
+void Gui::setTextureStats(const TextureBudgetStats& stats)
+{
+    m_texture_stats = stats;
+}
+
+void Gui::setLoopStats(double wakeups_per_sec, double frames_per_sec, double cpu_percent)
+{
+    m_wakeups_per_sec = wakeups_per_sec;
+    m_frames_per_sec = frames_per_sec;
+    m_cpu_percent = cpu_percent;
+}
+
+void Gui::setAutosaveStats(double capture_time, double write_time, uint64_t saves)
+{
+    m_autosave_capture_ms = capture_time * 1000.0;
+    m_autosave_write_ms = write_time * 1000.0;
+    m_autosaves = saves;
+}
+
+void Gui::setUndoStats(size_t bytes, size_t steps, size_t cursor)
+{
+    m_undo_bytes = bytes;
+    m_undo_steps = steps;
+    m_history_cursor = static_cast<int>(cursor);
+}
+
+void Gui::setBundleMaps(const std::vector<std::string>& names)
+{
+    m_bundle_maps = names;
+}
+
+std::string Gui::getBundleMap(int index) const
+{
+    return index >= 0 && index < static_cast<int>(m_bundle_maps.size()) ? m_bundle_maps[index] : std::string();
+}
+
 ALLEGRO_EVENT_SOURCE *Gui::getEventSource()
 {
     return &m_event_source;
@@ -101,6 +149,8 @@ void Gui::render()
     }
 
     renderInitiativeTracker(main_menu_height);
+    renderImportProgress();
+    renderStatusBar();
 
     ImGui::Render();
 
@@ -125,6 +175,30 @@ int Gui::renderMainMenu()
                 memset(Gui::load_file_buffer, 0, sizeof(Gui::load_file_buffer));
                 state = GUI_STATE::LOAD_POPUP;
             }
+            ImGui::Separator();
+            if (ImGui::MenuItem("Save to Campaign"))
+            {
+                ALLEGRO_EVENT ev;
+                ev.user.type = AXE_GUI_EVENT_SAVE_TO_BUNDLE;
+                ev.user.data1 = m_embed_decoded;
+                al_emit_user_event(&m_event_source, &ev, nullptr);
+            }
+            if (ImGui::BeginMenu("Open from Campaign", !m_bundle_maps.empty()))
+            {
+                for (size_t i = 0; i < m_bundle_maps.size(); ++i)
+                {
+                    if (ImGui::MenuItem(m_bundle_maps[i].c_str()))
+                    {
+                        ALLEGRO_EVENT ev;
+                        ev.user.type = AXE_GUI_EVENT_OPEN_BUNDLE_MAP;
+                        ev.user.data1 = static_cast<intptr_t>(i);
+                        al_emit_user_event(&m_event_source, &ev, nullptr);
+                    }
+                }
+                ImGui::EndMenu();
+            }
+            ImGui::MenuItem("Embed Decoded Images", nullptr, &m_embed_decoded);
+            ImGui::Separator();
             if (ImGui::MenuItem("Show Demo Window")) m_show_demo_window = true;
             if (ImGui::MenuItem("Exit"))
             { 
@@ -134,6 +208,80 @@ int Gui::renderMainMenu()
             };
             ImGui::EndMenu();
         }
+        if (ImGui::BeginMenu("Edit"))
+        {
+            // 0 is the oldest step kept, every position is one edit later
+            ImGui::SetNextItemWidth(240);
+            if (ImGui::SliderInt("History", &m_history_cursor, 0, static_cast<int>(m_undo_steps)) && m_undo_steps > 0)
+            {
+                ALLEGRO_EVENT ev;
+                ev.user.type = AXE_GUI_EVENT_JUMP_HISTORY;
+                ev.user.data1 = m_history_cursor;
+                al_emit_user_event(&m_event_source, &ev, nullptr);
+            }
+            ImGui::EndMenu();
+        }
+        if (ImGui::BeginMenu("Settings"))
+        {
+            ImGui::SetNextItemWidth(120);
+            if (ImGui::InputInt("Texture Budget (MB)", &m_texture_budget_mb, 64, 256, ImGuiInputTextFlags_EnterReturnsTrue))
+            {
+                if (m_texture_budget_mb < 64) m_texture_budget_mb = 64;
+
+                ALLEGRO_EVENT ev;
+                ev.user.type = AXE_GUI_EVENT_SET_TEXTURE_BUDGET;
+                ev.user.data1 = m_texture_budget_mb;
+                al_emit_user_event(&m_event_source, &ev, nullptr);
+            }
+            if (ImGui::MenuItem("Fog Mask Rendering", nullptr, &m_fog_mask))
+            {
+                ALLEGRO_EVENT ev;
+                ev.user.type = AXE_GUI_EVENT_SET_RENDER_MODE;
+                ev.user.data1 = m_fog_mask;
+                al_emit_user_event(&m_event_source, &ev, nullptr);
+            }
+            if (ImGui::MenuItem("Retained Render Cache", nullptr, &m_render_cache))
+            {
+                ALLEGRO_EVENT ev;
+                ev.user.type = AXE_GUI_EVENT_SET_RENDER_CACHE;
+                ev.user.data1 = m_render_cache;
+                al_emit_user_event(&m_event_source, &ev, nullptr);
+            }
+            if (ImGui::MenuItem("Live Viewer Sync", nullptr, &m_live_sync))
+            {
+                ALLEGRO_EVENT ev;
+                ev.user.type = AXE_GUI_EVENT_SET_LIVE_SYNC;
+                ev.user.data1 = m_live_sync;
+                al_emit_user_event(&m_event_source, &ev, nullptr);
+            }
+            ImGui::Separator();
+            ImGui::SetNextItemWidth(120);
+            bool autosave_changed = ImGui::InputInt("Autosave Interval (s)", &m_autosave_interval, 30, 300, ImGuiInputTextFlags_EnterReturnsTrue);
+            ImGui::SetNextItemWidth(120);
+            autosave_changed |= ImGui::InputInt("Autosave Generations", &m_autosave_generations, 1, 5, ImGuiInputTextFlags_EnterReturnsTrue);
+            if (autosave_changed)
+            {
+                if (m_autosave_interval < 0) m_autosave_interval = 0; // 0 turns it off
+                if (m_autosave_generations < 1) m_autosave_generations = 1;
+
+                ALLEGRO_EVENT ev;
+                ev.user.type = AXE_GUI_EVENT_SET_AUTOSAVE;
+                ev.user.data1 = m_autosave_interval;
+                ev.user.data2 = m_autosave_generations;
+                al_emit_user_event(&m_event_source, &ev, nullptr);
+            }
+            ImGui::SetNextItemWidth(120);
+            if (ImGui::InputInt("Undo Memory (MB)", &m_undo_budget_mb, 8, 64, ImGuiInputTextFlags_EnterReturnsTrue))
+            {
+                if (m_undo_budget_mb < 1) m_undo_budget_mb = 1;
+
+                ALLEGRO_EVENT ev;
+                ev.user.type = AXE_GUI_EVENT_SET_UNDO_BUDGET;
+                ev.user.data1 = m_undo_budget_mb;
+                al_emit_user_event(&m_event_source, &ev, nullptr);
+            }
+            ImGui::EndMenu();
+        }
         height = ImGui::GetWindowHeight();
         ImGui::EndMainMenuBar();
     }
@@ -172,4 +320,49 @@ void Gui::renderInitiativeTracker(int menu_height)
 
         ImGui::End();
     }
-}
\ No newline at end of file
+}
+
+void Gui::renderImportProgress()
+{
+    if (!m_importing) return;
+
+    ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+    ImGui::SetNextWindowPos(center, ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+    if (ImGui::Begin("Importing Map", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoMove))
+    {
+        ImGui::TextUnformatted(m_import_stage.c_str());
+        ImGui::ProgressBar(m_import_progress, ImVec2(300, 0));
+
+        if (ImGui::Button("Cancel", ImVec2(120, 0)))
+        {
+            ALLEGRO_EVENT ev;
+            ev.user.type = AXE_GUI_EVENT_CANCEL_IMPORT;
+            al_emit_user_event(&m_event_source, &ev, nullptr);
+        }
+    }
+    ImGui::End();
+}
+
+void Gui::renderStatusBar()
+{
+    vec2i res = getScreenSize();
+    ImGui::SetNextWindowSize(ImVec2(res.x, BOTTOM_BAR_HEIGHT), ImGuiCond_Always);
+    ImGui::SetNextWindowPos(ImVec2(0, res.y - BOTTOM_BAR_HEIGHT), ImGuiCond_Always);
+    if (ImGui::Begin("Status", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings))
+    {
+        constexpr double MB = 1024.0 * 1024.0;
+        ImGui::Text("Textures: %.1f / %.1f MB    Evictions: %llu    Reloads: %llu    Reload stalls: %llu",
+            m_texture_stats.resident_bytes / MB, m_texture_stats.budget / MB,
+            static_cast<unsigned long long>(m_texture_stats.evictions),
+            static_cast<unsigned long long>(m_texture_stats.reloads),
+            static_cast<unsigned long long>(m_texture_stats.reload_stalls));
+        ImGui::SameLine();
+        ImGui::Text("    Wakeups/s: %.1f    Frames/s: %.1f    CPU: %.1f%%", m_wakeups_per_sec, m_frames_per_sec, m_cpu_percent);
+        ImGui::SameLine();
+        ImGui::Text("    Autosaves: %llu    Snapshot: %.2f ms    Write: %.1f ms",
+            static_cast<unsigned long long>(m_autosaves), m_autosave_capture_ms, m_autosave_write_ms);
+        ImGui::SameLine();
+        ImGui::Text("    Undo: %.2f / %d MB (%llu steps)", m_undo_bytes / MB, m_undo_budget_mb, static_cast<unsigned long long>(m_undo_steps));
+    }
+    ImGui::End();
+}
@@ -0,0 +1,283 @@
+#include "image_cache.hpp"
+#include "util.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm> // std::sort
+#include <atomic>
+#include <cstring> // memcmp, memcpy
+#include <iomanip> // std::setw
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+constexpr char CACHE_MAGIC[4] = {'A', 'X', 'I', 'C'};
+constexpr uint32_t CACHE_VERSION = 1;
+constexpr uint64_t CACHE_ALIGN = 4096; // Level data starts on a page boundary so it can be mapped directly
+constexpr char CACHE_EXT[] = ".axc";
+
+// The cache is a local file, so the header is stored in native byte order
+struct CacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t source_hash;
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint32_t level_count;
+	uint32_t reserved;
+};
+
+struct CacheLevel
+{
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+};
+
+static std::mutex cache_mutex;
+static std::string cache_dir;
+static bool cache_dir_set = false;
+static uint64_t cache_limit = IMAGE_CACHE_DEFAULT_LIMIT;
+
+void setImageCacheDir(const std::string& dir)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	cache_dir = dir;
+	cache_dir_set = true;
+}
+
+void setImageCacheLimit(uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	cache_limit = bytes;
+}
+
+std::string getImageCacheDir()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (!cache_dir_set)
+	{
+		cache_dir = getCacheDir();
+		cache_dir_set = true;
+	}
+	return cache_dir;
+}
+
+uint64_t getImageCacheLimit()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return cache_limit;
+}
+
+static bool hashFile(const std::string& path, uint64_t& hash)
+{
+	std::ifstream in(path, std::ifstream::binary);
+	if (!in.is_open()) return false;
+
+	std::vector<char> buf(1 << 20);
+	hash = HASH_SEED;
+
+	while (in)
+	{
+		in.read(buf.data(), buf.size());
+		hash = hashBytes(buf.data(), static_cast<size_t>(in.gcount()), hash);
+	}
+
+	return in.eof();
+}
+
+bool getImageCacheKey(const std::string& source_path, ImageCacheKey& key)
+{
+	std::string dir = getImageCacheDir();
+	if (dir.empty()) return false;
+
+	std::error_code ec;
+	key.source_size = fs::file_size(source_path, ec);
+	if (ec) return false;
+
+	auto mtime = fs::last_write_time(source_path, ec);
+	if (ec) return false;
+	key.source_mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+
+	if (!hashFile(source_path, key.source_hash)) return false;
+
+	std::stringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << key.source_hash << CACHE_EXT;
+	key.entry_path = (fs::path(dir) / ss.str()).string();
+
+	return true;
+}
+
+bool loadCachedImage(DecodedImage& img, const ImageCacheKey& key)
+{
+	auto file = std::make_shared<MappedFile>();
+	if (!file->open(key.entry_path)) return false;
+
+	const uint8_t* base = file->data();
+	const size_t size = file->size();
+
+	CacheHeader header;
+	if (size < sizeof(header)) return false;
+	memcpy(&header, base, sizeof(header));
+
+	bool valid = memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && header.version == CACHE_VERSION;
+	bool fresh = header.source_hash == key.source_hash && header.source_size == key.source_size && header.source_mtime == key.source_mtime;
+
+	if (!valid || !fresh || header.level_count == 0 || header.level_count > MAP_IMAGE_MAX_LEVELS)
+	{
+		file->close();
+
+		std::error_code ec;
+		fs::remove(key.entry_path, ec);
+		return false;
+	}
+
+	if (size < sizeof(header) + sizeof(CacheLevel) * header.level_count) return false;
+
+	std::vector<ImageLevel> levels(header.level_count);
+
+	for (uint32_t i = 0; i < header.level_count; ++i)
+	{
+		CacheLevel cl;
+		memcpy(&cl, base + sizeof(header) + sizeof(CacheLevel) * i, sizeof(cl));
+
+		ImageLevel& level = levels[i];
+		level.width = static_cast<int>(cl.width);
+		level.height = static_cast<int>(cl.height);
+
+		if (cl.width == 0 || cl.height == 0 || cl.width > (1u << 20) || cl.height > (1u << 20)) return false;
+		if (cl.offset > size || level.bytes() > size - cl.offset) return false;
+
+		level.mapped = base + cl.offset;
+	}
+
+	img.levels = std::move(levels);
+	img.mapping = file;
+
+	// The entry's mtime doubles as its last use for LRU eviction
+	std::error_code ec;
+	fs::last_write_time(key.entry_path, fs::file_time_type::clock::now(), ec);
+
+	return true;
+}
+
+bool storeCachedImage(const DecodedImage& img, const ImageCacheKey& key)
+{
+	if (img.levels.empty() || img.levels.size() > MAP_IMAGE_MAX_LEVELS || key.entry_path.empty()) return false;
+
+	std::error_code ec;
+	fs::create_directories(fs::path(key.entry_path).parent_path(), ec);
+	if (ec)
+	{
+		std::cerr << "Failed to create image cache directory: " << ec.message() << std::endl;
+		return false;
+	}
+
+	CacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.source_hash = key.source_hash;
+	header.source_size = key.source_size;
+	header.source_mtime = key.source_mtime;
+	header.level_count = static_cast<uint32_t>(img.levels.size());
+	header.reserved = 0;
+
+	std::vector<CacheLevel> table(img.levels.size());
+	uint64_t offset = sizeof(header) + sizeof(CacheLevel) * table.size();
+
+	for (size_t i = 0; i < img.levels.size(); ++i)
+	{
+		offset = (offset + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+		table[i].width = static_cast<uint32_t>(img.levels[i].width);
+		table[i].height = static_cast<uint32_t>(img.levels[i].height);
+		table[i].offset = offset;
+		offset += img.levels[i].bytes();
+	}
+
+	// Written under a unique name and renamed, so a reader never maps a half written entry
+	static std::atomic<unsigned> tmp_counter{0};
+	std::string tmp_path = key.entry_path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "-" + std::to_string(tmp_counter++);
+
+	{
+		std::ofstream out(tmp_path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+		if (!out.is_open()) return false;
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(table.data()), sizeof(CacheLevel) * table.size());
+		uint64_t written = sizeof(header) + sizeof(CacheLevel) * table.size();
+
+		for (size_t i = 0; i < img.levels.size(); ++i)
+		{
+			std::vector<char> pad(static_cast<size_t>(table[i].offset - written), 0);
+			out.write(pad.data(), pad.size());
+			out.write(reinterpret_cast<const char*>(img.levels[i].data()), img.levels[i].bytes());
+			written = table[i].offset + img.levels[i].bytes();
+		}
+
+		if (!out)
+		{
+			out.close();
+			fs::remove(tmp_path, ec);
+			std::cerr << "Failed to write image cache entry: " << key.entry_path << std::endl;
+			return false;
+		}
+	}
+
+	fs::rename(tmp_path, key.entry_path, ec);
+	if (ec)
+	{
+		fs::remove(tmp_path, ec);
+		return false;
+	}
+
+	trimImageCache();
+
+	return true;
+}
+
+void trimImageCache()
+{
+	struct Entry
+	{
+		fs::path path;
+		fs::file_time_type last_used;
+		uint64_t size;
+	};
+
+	std::string dir = getImageCacheDir();
+	uint64_t limit = getImageCacheLimit();
+	if (dir.empty()) return;
+
+	std::error_code ec;
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+	{
+		std::error_code entry_ec;
+		if (!it->is_regular_file(entry_ec) || it->path().extension() != CACHE_EXT) continue;
+
+		Entry e{it->path(), it->last_write_time(entry_ec), it->file_size(entry_ec)};
+		if (entry_ec) continue;
+
+		total += e.size;
+		entries.push_back(std::move(e));
+	}
+
+	if (total <= limit) return;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+
+	// On Linux a mapped entry can still be removed, the mapping stays valid until it is closed.
+	// Windows refuses to remove it, which just leaves it for the next trim.
+	for (const Entry& e : entries)
+	{
+		if (total <= limit) break;
+		if (fs::remove(e.path, ec)) total -= e.size;
+	}
+}
@@ -0,0 +1,352 @@
+#include "image_import.hpp"
+#include "bundle.hpp"
+#include "image_cache.hpp"
+#include "thread_pool.hpp"
+#include "texture_budget.hpp"
+
+#include <iostream>
+#include <algorithm> // std::min, std::max
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+using std_clk = std::chrono::steady_clock;
+
+constexpr int LEVEL_BAND_ROWS = 64; // Rows of a downscaled level built per task
+
+// Where each stage starts on the progress bar
+constexpr float PROGRESS_DECODE = 0.0f;
+constexpr float PROGRESS_LEVELS = 0.4f;
+constexpr float PROGRESS_SLICE = 0.6f;
+constexpr float PROGRESS_UPLOAD = 0.8f;
+
+struct ImageImport::State
+{
+	std::string path;
+	int page_size;
+	bool slice_pages;
+
+	std::atomic<int> stage{IMPORT_QUEUED};
+	std::atomic<bool> cancelled{false};
+	std::atomic<float> progress{0.0f};
+
+	// Owned by the worker until stage reaches IMPORT_UPLOAD, then by the display thread
+	std::shared_ptr<DecodedImage> decoded = std::make_shared<DecodedImage>(); // Kept by the MapImage to reload evicted pages
+	std::vector<ImagePage> pages;
+	ImageCacheKey cache_key;
+	bool cacheable = false;
+	ImportStats stats;
+};
+
+double ImportStats::throughput() const
+{
+	double t = cpuTime();
+	return t > 0.0 ? (source_bytes / (1024.0 * 1024.0)) / t : 0.0;
+}
+
+static double secondsSince(std_clk::time_point start)
+{
+	return std::chrono::duration<double>(std_clk::now() - start).count();
+}
+
+static bool stopIfCancelled(ImageImport::State& s)
+{
+	if (!s.cancelled) return false;
+
+	s.stage = IMPORT_CANCELLED;
+	return true;
+}
+
+static void buildLevels(ImageImport::State& s)
+{
+	DecodedImage& img = *s.decoded;
+	img.levels.resize(1);
+
+	int total_rows = 0;
+	for (int w = img.levels[0].width, h = img.levels[0].height, l = 1; l < MAP_IMAGE_MAX_LEVELS; ++l)
+	{
+		w = std::max(1, (w + 1) / 2);
+		h = std::max(1, (h + 1) / 2);
+		total_rows += h;
+	}
+
+	std::atomic<int> rows_done{0};
+
+	while (static_cast<int>(img.levels.size()) < MAP_IMAGE_MAX_LEVELS && !s.cancelled)
+	{
+		const ImageLevel& last = img.levels.back();
+		if (last.width <= 1 && last.height <= 1) break;
+
+		ImageLevel next = createHalfLevel(last);
+		size_t bands = (next.height + LEVEL_BAND_ROWS - 1) / LEVEL_BAND_ROWS;
+
+		getWorkerPool().parallelFor(bands, [&](size_t b)
+		{
+			if (s.cancelled) return;
+
+			int y0 = static_cast<int>(b) * LEVEL_BAND_ROWS;
+			downsampleRows(last, next, y0, y0 + LEVEL_BAND_ROWS);
+
+			int done = rows_done += LEVEL_BAND_ROWS;
+			s.progress = PROGRESS_LEVELS + (PROGRESS_SLICE - PROGRESS_LEVELS) * std::min(1.0f, static_cast<float>(done) / std::max(1, total_rows));
+		});
+
+		img.levels.push_back(std::move(next));
+	}
+}
+
+static void slicePages(ImageImport::State& s)
+{
+	struct PageRef { int level, col, row; };
+	std::vector<PageRef> refs;
+
+	for (size_t l = 0; l < s.decoded->levels.size(); ++l)
+	{
+		const ImageLevel& level = s.decoded->levels[l];
+		int cols = (level.width + s.page_size - 1) / s.page_size;
+		int rows = (level.height + s.page_size - 1) / s.page_size;
+
+		for (int r = 0; r < rows; ++r)
+			for (int c = 0; c < cols; ++c)
+				refs.push_back(PageRef{static_cast<int>(l), c, r});
+	}
+
+	s.pages.resize(refs.size());
+	std::atomic<size_t> pages_done{0};
+
+	getWorkerPool().parallelFor(refs.size(), [&](size_t i)
+	{
+		if (s.cancelled) return;
+
+		s.pages[i] = sliceImagePage(*s.decoded, refs[i].level, refs[i].col, refs[i].row, s.page_size);
+		s.progress = PROGRESS_SLICE + (PROGRESS_UPLOAD - PROGRESS_SLICE) * (static_cast<float>(++pages_done) / refs.size());
+	});
+}
+
+static void runImport(std::shared_ptr<ImageImport::State> state)
+{
+	ImageImport::State& s = *state;
+	if (stopIfCancelled(s)) return;
+
+	// Decode, or map the cached pyramid and skip straight to upload
+	s.stage = IMPORT_DECODE;
+	s.progress = PROGRESS_DECODE;
+	auto start = std_clk::now();
+
+	std::error_code ec;
+	s.stats.source_bytes = std::filesystem::file_size(s.path, ec);
+
+	// Bundles with a pre-decoded pyramid count as a cache hit, otherwise their embedded source is decoded
+	bool decoded = false;
+	if (isBundleImagePath(s.path))
+	{
+		decoded = loadBundleImage(*s.decoded, s.path, s.stats.cache_hit);
+	}
+	else
+	{
+		s.cacheable = getImageCacheKey(s.path, s.cache_key);
+		s.stats.cache_hit = s.cacheable && loadCachedImage(*s.decoded, s.cache_key);
+		decoded = s.stats.cache_hit || decodeImage(*s.decoded, s.path);
+	}
+
+	if (!decoded)
+	{
+		s.stage = IMPORT_FAILED;
+		return;
+	}
+
+	s.stats.decode_time = secondsSince(start);
+	if (stopIfCancelled(s)) return;
+
+	if (!s.stats.cache_hit)
+	{
+		s.stage = IMPORT_LEVELS;
+		s.progress = PROGRESS_LEVELS;
+		start = std_clk::now();
+
+		buildLevels(s);
+
+		s.stats.levels_time = secondsSince(start);
+		if (stopIfCancelled(s)) return;
+
+		// Cached pages are uploaded straight from the mapping, only fresh decodes are sliced
+		if (s.slice_pages)
+		{
+			s.stage = IMPORT_SLICE;
+			s.progress = PROGRESS_SLICE;
+			start = std_clk::now();
+
+			slicePages(s);
+
+			s.stats.slice_time = secondsSince(start);
+			if (stopIfCancelled(s)) return;
+		}
+
+		if (s.cacheable)
+		{
+			// Writing the cache entry doesn't hold up the upload, upload() only reads
+			getWorkerPool().submit([state]() { storeCachedImage(*state->decoded, state->cache_key); });
+		}
+	}
+
+	s.progress = PROGRESS_UPLOAD;
+	s.stage = IMPORT_UPLOAD;
+
+	// A cancel since the last check saw a CPU stage and left finishing it to us
+	stopIfCancelled(s);
+}
+
+ImageImport::ImageImport(const std::string& path, int page_size, bool slice_pages) : state(std::make_shared<State>())
+{
+	state->path = path;
+	state->page_size = page_size;
+	state->slice_pages = slice_pages;
+
+	std::shared_ptr<State> s = state;
+	getWorkerPool().submit([s]() { runImport(s); });
+}
+
+ImageImport::~ImageImport()
+{
+	cancel();
+	destroyMapImage(image); // A partial upload, unless it was taken
+}
+
+void ImageImport::cancel()
+{
+	state->cancelled = true;
+
+	// Nothing is running once the CPU stages are done, so finish the cancel here
+	int stage = state->stage;
+	if (stage == IMPORT_UPLOAD) state->stage = IMPORT_CANCELLED;
+}
+
+IMPORT_STAGE ImageImport::getStage() const
+{
+	return static_cast<IMPORT_STAGE>(state->stage.load());
+}
+
+const char* ImageImport::getStageName() const
+{
+	switch (getStage())
+	{
+		case IMPORT_QUEUED: return "Waiting";
+		case IMPORT_DECODE: return "Decoding";
+		case IMPORT_LEVELS: return "Building levels";
+		case IMPORT_SLICE: return "Slicing pages";
+		case IMPORT_UPLOAD: return "Uploading";
+		case IMPORT_DONE: return "Done";
+		case IMPORT_FAILED: return "Failed";
+		case IMPORT_CANCELLED: return "Cancelled";
+		default: return "";
+	}
+}
+
+float ImageImport::getProgress() const
+{
+	return state->progress;
+}
+
+const std::string& ImageImport::getPath() const
+{
+	return state->path;
+}
+
+ImportStats ImageImport::getStats() const
+{
+	return state->stats;
+}
+
+bool ImageImport::isFinished() const
+{
+	IMPORT_STAGE stage = getStage();
+	return stage == IMPORT_DONE || stage == IMPORT_FAILED || stage == IMPORT_CANCELLED;
+}
+
+bool ImageImport::upload(double time_budget)
+{
+	State& s = *state;
+	if (getStage() != IMPORT_UPLOAD || stopIfCancelled(s)) return false;
+
+	auto start = std_clk::now();
+
+	if (upload_level < 0 && !isMapImageLoaded(image))
+	{
+		layoutMapImage(image, s.decoded, s.page_size);
+		upload_level = static_cast<int>(image.levels.size()) - 1;
+
+		for (const ImagePageLevel& level : image.levels)
+		{
+			level_offsets.push_back(pages_total);
+			pages_total += level.pages.size();
+		}
+
+		// Sliced pages are in level, row, column order, the same as the layout
+		if (s.pages.size() != pages_total) s.pages.clear();
+	}
+
+	// Coarsest level first, finer pages that don't fit the texture budget are left for the first draw that needs them
+	const int coarsest = static_cast<int>(image.levels.size()) - 1;
+	bool ok = true;
+	bool done = upload_level < 0;
+
+	while (!done)
+	{
+		if (upload_level != coarsest && isOverTextureBudget())
+		{
+			done = true;
+			break;
+		}
+
+		const ImagePageLevel& level = image.levels[upload_level];
+		if (s.pages.empty()) ok = uploadImagePage(image, upload_level, upload_page % level.cols, upload_page / level.cols);
+		else ok = uploadImagePage(image, s.pages[level_offsets[upload_level] + upload_page]);
+
+		if (!ok) break;
+
+		++pages_uploaded;
+		if (++upload_page == static_cast<int>(level.pages.size()))
+		{
+			placeholder_ready = true;
+			upload_page = 0;
+			done = --upload_level < 0;
+		}
+
+		if (secondsSince(start) >= time_budget) break;
+	}
+
+	s.stats.upload_time += secondsSince(start);
+
+	if (!ok)
+	{
+		std::cerr << "Failed to upload map image: " << s.path << std::endl;
+		destroyMapImage(image);
+		placeholder_ready = false;
+		s.stage = IMPORT_FAILED;
+		return false;
+	}
+
+	s.progress = PROGRESS_UPLOAD + (1.0f - PROGRESS_UPLOAD) * static_cast<float>(pages_uploaded) / std::max<size_t>(1, pages_total);
+
+	if (done)
+	{
+		s.pages.clear();
+		s.pages.shrink_to_fit();
+		s.progress = 1.0f;
+		s.stage = IMPORT_DONE;
+	}
+
+	return true;
+}
+
+bool ImageImport::takeImage(MapImage& img)
+{
+	if (getStage() != IMPORT_DONE || !isMapImageLoaded(image)) return false;
+
+	img = image;
+	image = MapImage();
+	placeholder_ready = false;
+
+	return true;
+}
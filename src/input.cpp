@@ -1,8 +1,65 @@
 #include "input.hpp"
 
 #include <iostream> // For std::cerr
+#include <cctype> // tolower, isspace
+#include <cstring> // memset
+#include <array>
+#include <fstream>
+#include <set>
+#include <sstream>
 
-InputHandler::InputHandler() : modifiers(0)
+static std::string toLower(std::string s)
+{
+	for (char& c : s) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+	return s;
+}
+
+static std::string trim(const std::string& s)
+{
+	size_t b = 0, e = s.size();
+	while (b < e && isspace(static_cast<unsigned char>(s[b]))) ++b;
+	while (e > b && isspace(static_cast<unsigned char>(s[e - 1]))) --e;
+	return s.substr(b, e - b);
+}
+
+static int getChord(int allegro_modifiers)
+{
+	int chord = CHORD_NONE;
+	if (allegro_modifiers & ALLEGRO_KEYMOD_CTRL) chord |= CHORD_CTRL;
+	if (allegro_modifiers & ALLEGRO_KEYMOD_SHIFT) chord |= CHORD_SHIFT;
+	if (allegro_modifiers & ALLEGRO_KEYMOD_ALT) chord |= CHORD_ALT;
+	return chord;
+}
+
+// For each chord, the chords it falls back to when nothing is bound: itself, then every
+// subset with one modifier fewer, and so on down to CHORD_NONE. Ends early with -1.
+using ChordFallbacks = std::array<std::array<int8_t, CHORD_COUNT>, CHORD_COUNT>;
+
+static ChordFallbacks makeChordFallbacks()
+{
+	auto bits = [](int chord) { return (chord & 1) + ((chord >> 1) & 1) + ((chord >> 2) & 1); };
+
+	ChordFallbacks fallbacks;
+	for (int chord = 0; chord < CHORD_COUNT; ++chord)
+	{
+		fallbacks[chord].fill(-1);
+
+		int n = 0;
+		for (int b = bits(chord); b >= 0; --b)
+		{
+			for (int sub = 0; sub < CHORD_COUNT; ++sub)
+			{
+				if ((sub & ~chord) == 0 && bits(sub) == b) fallbacks[chord][n++] = static_cast<int8_t>(sub);
+			}
+		}
+	}
+
+	return fallbacks;
+}
+
+static const ChordFallbacks chord_fallbacks = makeChordFallbacks();
+
+InputHandler::InputHandler() : modifiers(0), generation(1), hold_epoch(1)
 {
 	if (!al_is_system_installed())
 	{
@@ -13,9 +70,11 @@ InputHandler::InputHandler() : modifiers(0)
 	al_install_keyboard();
 	al_install_mouse();
 
-	memset(keys_pressed, false, sizeof(bool) * CUSTOM_ALLEGRO_KEY_MAX);
-	memset(keys_held, false, sizeof(bool) * CUSTOM_ALLEGRO_KEY_MAX);
-	memset(keys_released, false, sizeof(bool) * CUSTOM_ALLEGRO_KEY_MAX);
+	memset(keys_pressed, 0, sizeof(keys_pressed));
+	memset(keys_released, 0, sizeof(keys_released));
+	memset(keys_held, 0, sizeof(keys_held));
+	memset(bindings, 0, sizeof(bindings));
+	memset(held_actions, 0, sizeof(held_actions));
 }
 
 InputHandler::~InputHandler()
@@ -26,54 +85,43 @@ InputHandler::~InputHandler()
 
 void InputHandler::getInput(const ALLEGRO_EVENT &ev)
 {
-	memset(keys_pressed, false, sizeof(bool) * CUSTOM_ALLEGRO_KEY_MAX);
-	memset(keys_released, false, sizeof(bool) * CUSTOM_ALLEGRO_KEY_MAX);
-
-	mouse_wheel_down = false;
-	mouse_wheel_up = false;
+	++generation;
 
 	switch (ev.type)
 	{
 		case ALLEGRO_EVENT_MOUSE_AXES:
+			mouse_position = { ev.mouse.x, ev.mouse.y };
+
+			// Wheel notches only press, there is nothing to release
 			if (ev.mouse.dz > 0)
 			{
-				callKeybind(MOUSE::WHEELUP, true);
-				mouse_wheel_up = true;
+				press(MOUSE::WHEELUP);
+				keys_held[MOUSE::WHEELUP] = 0;
 			}
 			else if (ev.mouse.dz < 0)
 			{
-				callKeybind(MOUSE::WHEELDOWN, true);
-				mouse_wheel_down = true;
+				press(MOUSE::WHEELDOWN);
+				keys_held[MOUSE::WHEELDOWN] = 0;
 			}
-
-			mouse_position = { ev.mouse.x, ev.mouse.y };
 		break;
 
 		case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
-			callKeybind(ALLEGRO_KEY_MAX + ev.mouse.button, true);
-			keys_pressed[ALLEGRO_KEY_MAX + ev.mouse.button] = true;
-			keys_held[ALLEGRO_KEY_MAX + ev.mouse.button] = true;
+			if (ALLEGRO_KEY_MAX + ev.mouse.button < MOUSE::WHEELUP) press(ALLEGRO_KEY_MAX + ev.mouse.button);
 		break;
 
 		case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
-			callKeybind(ALLEGRO_KEY_MAX + ev.mouse.button, false);
-			keys_released[ALLEGRO_KEY_MAX + ev.mouse.button] = true;
-			keys_held[ALLEGRO_KEY_MAX + ev.mouse.button] = false;
+			if (ALLEGRO_KEY_MAX + ev.mouse.button < MOUSE::WHEELUP) release(ALLEGRO_KEY_MAX + ev.mouse.button);
 		break;
 
 		case ALLEGRO_EVENT_KEY_DOWN:
 			// Catch modifier keys
 			modifiers = ev.keyboard.modifiers;
-			callKeybind(ev.keyboard.keycode, true);
-			keys_pressed[ev.keyboard.keycode] = true;
-			keys_held[ev.keyboard.keycode] = true;
+			press(ev.keyboard.keycode);
 		break;
 
 		case ALLEGRO_EVENT_KEY_UP:
 			modifiers = ev.keyboard.modifiers;
-			callKeybind(ev.keyboard.keycode, false);
-			keys_released[ev.keyboard.keycode] = true;
-			keys_held[ev.keyboard.keycode] = false;
+			release(ev.keyboard.keycode);
 		break;
 
 		default:
@@ -81,24 +129,48 @@ void InputHandler::getInput(const ALLEGRO_EVENT &ev)
 	};
 }
 
+void InputHandler::press(int key)
+{
+	keys_pressed[key] = generation;
+	keys_held[key] = hold_epoch;
+
+	uint16_t id = 0;
+	for (int8_t chord : chord_fallbacks[getChord(modifiers)])
+	{
+		if (chord < 0 || (id = bindings[chord][key]) != 0) break;
+	}
+
+	held_actions[key] = id;
+	if (id != 0 && actions[id - 1].on_pressed) actions[id - 1].on_pressed();
+}
+
+void InputHandler::release(int key)
+{
+	keys_released[key] = generation;
+	keys_held[key] = 0;
+
+	uint16_t id = held_actions[key];
+	held_actions[key] = 0;
+	if (id != 0 && actions[id - 1].on_released) actions[id - 1].on_released();
+}
+
 void InputHandler::releaseKeys()
 {
-	memset(keys_pressed,  false, sizeof(bool) * CUSTOM_ALLEGRO_KEY_MAX);
-	memset(keys_held, 	  false, sizeof(bool) * CUSTOM_ALLEGRO_KEY_MAX);
-	memset(keys_released, false, sizeof(bool) * CUSTOM_ALLEGRO_KEY_MAX);
+	++generation;
+	++hold_epoch;
 }
 
 bool InputHandler::isKeyPressed(const int key, const int mod) const
 {
-	return keys_pressed[key] && (mod == -1 || mod & modifiers);
+	return keys_pressed[key] == generation && (mod == -1 || mod & modifiers);
 }
 bool InputHandler::isKeyReleased(const int key, const int mod) const
 {
-	return keys_released[key] && (mod == -1 || mod & modifiers);
+	return keys_released[key] == generation && (mod == -1 || mod & modifiers);
 }
 bool InputHandler::isKeyDown(const int key, const int mod) const
 {
-	return keys_held[key] && (mod == -1 || mod & modifiers);
+	return keys_held[key] == hold_epoch && (mod == -1 || mod & modifiers);
 }
 
 bool InputHandler::isMousePressed(int button, const int mod) const
@@ -116,11 +188,11 @@ bool InputHandler::isMouseDown(int button, const int mod) const
 
 bool InputHandler::isMouseWheelDown(const int mod) const
 {
-	return mouse_wheel_down && (mod == -1 || mod & modifiers);
+	return isKeyPressed(MOUSE::WHEELDOWN, mod);
 }
 bool InputHandler::isMouseWheelUp(const int mod) const
 {
-	return mouse_wheel_up && (mod == -1 || mod & modifiers);
+	return isKeyPressed(MOUSE::WHEELUP, mod);
 }
 
 vec2i InputHandler::getMousePos(void) const
@@ -133,35 +205,138 @@ bool InputHandler::isModifierDown(const int mod)
 	return mod & modifiers;
 }
 
-void InputHandler::setKeybind(int key, std::function<void(void)> callback, bool pressed)
+uint16_t InputHandler::getActionId(const std::string& name)
 {
-	if (pressed) keybinds_p[key] = callback;
-	else keybinds_r[key] = callback;
+	auto it = action_ids.find(name);
+	if (it != action_ids.end()) return it->second;
+
+	actions.push_back({name, nullptr, nullptr});
+	uint16_t id = static_cast<uint16_t>(actions.size());
+	action_ids[name] = id;
+	return id;
 }
 
-// TODO: Need to make keybinds easier to clear, attach some sort of meta data about who created the keybind?
-void InputHandler::clearKeybind(int key)
+void InputHandler::setAction(const std::string& name, std::function<void(void)> on_pressed, std::function<void(void)> on_released)
 {
-	auto it = keybinds_p.find(key);
-	if (it != keybinds_p.end()) keybinds_p.erase(it);
+	Action& a = actions[getActionId(name) - 1];
+	a.on_pressed = on_pressed;
+	a.on_released = on_released;
+}
 
-	it = keybinds_r.find(key);
-	if (it != keybinds_r.end()) keybinds_r.erase(it);
+void InputHandler::clearAction(const std::string& name)
+{
+	setAction(name, nullptr, nullptr);
 }
 
-void InputHandler::clearKeybinds()
+int InputHandler::parseKey(const std::string& name)
 {
-	keybinds_p.clear();
-	keybinds_r.clear();
+	if (key_names.empty())
+	{
+		for (int k = 1; k < ALLEGRO_KEY_MAX; ++k)
+		{
+			const char* n = al_keycode_to_name(k);
+			if (n) key_names.emplace(toLower(n), k);
+		}
+
+		key_names["mouse_left"] = MOUSE::LEFT;
+		key_names["mouse_right"] = MOUSE::RIGHT;
+		key_names["mouse_middle"] = MOUSE::MIDDLE;
+		key_names["mouse_button4"] = MOUSE::BUTTON4;
+		key_names["mouse_button5"] = MOUSE::BUTTON5;
+		key_names["wheel_up"] = MOUSE::WHEELUP;
+		key_names["wheel_down"] = MOUSE::WHEELDOWN;
+	}
+
+	auto it = key_names.find(toLower(name));
+	return it == key_names.end() ? -1 : it->second;
 }
 
-void InputHandler::callKeybind(int key, bool pressed)
+bool InputHandler::bind(const std::string& name, const std::string& keys)
 {
-	if (pressed && keybinds_p.find(key) != keybinds_p.end())
+	int chord = CHORD_NONE;
+	int key = -1;
+
+	std::stringstream ss(keys);
+	std::string part;
+	while (std::getline(ss, part, '+'))
 	{
-		keybinds_p[key]();
-		return;
+		part = toLower(trim(part));
+
+		if (key != -1) return false; // The key comes last
+		else if (part == "ctrl") chord |= CHORD_CTRL;
+		else if (part == "shift") chord |= CHORD_SHIFT;
+		else if (part == "alt") chord |= CHORD_ALT;
+		else if ((key = parseKey(part)) == -1) return false;
 	}
 
-	if (keybinds_r.find(key) != keybinds_r.end()) keybinds_r[key]();
-}
\ No newline at end of file
+	if (key == -1) return false;
+
+	bindings[chord][key] = getActionId(name);
+	return true;
+}
+
+void InputHandler::unbind(const std::string& name)
+{
+	auto it = action_ids.find(name);
+	if (it == action_ids.end()) return;
+
+	for (auto& chord : bindings)
+	{
+		for (uint16_t& id : chord)
+		{
+			if (id == it->second) id = 0;
+		}
+	}
+}
+
+bool InputHandler::loadBindings(const std::string& text, const std::string& source, bool new_actions)
+{
+	std::set<std::string> seen;
+	std::stringstream ss(text);
+	std::string line;
+	bool ok = true;
+
+	for (int line_no = 1; std::getline(ss, line); ++line_no)
+	{
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) continue;
+
+		size_t eq = line.find('=');
+		std::string name = eq == std::string::npos ? "" : trim(line.substr(0, eq));
+		std::string keys = eq == std::string::npos ? "" : trim(line.substr(eq + 1));
+
+		if (name.empty() || keys.empty())
+		{
+			std::cerr << source << ":" << line_no << ": expected <action> = <keys>" << std::endl;
+			ok = false;
+			continue;
+		}
+
+		if (!new_actions && action_ids.find(name) == action_ids.end())
+		{
+			std::cerr << source << ":" << line_no << ": unknown action: " << name << std::endl;
+			ok = false;
+			continue;
+		}
+
+		if (seen.insert(name).second) unbind(name);
+
+		if (!bind(name, keys))
+		{
+			std::cerr << source << ":" << line_no << ": unknown keys: " << keys << std::endl;
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+bool InputHandler::loadBindingsFile(const std::string& file)
+{
+	std::ifstream in(file);
+	if (!in) return true;
+
+	std::stringstream text;
+	text << in.rdbuf();
+	return loadBindings(text.str(), file, false);
+}
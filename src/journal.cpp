@@ -0,0 +1,354 @@
+#include "journal.hpp"
+#include "util.hpp"
+#include "byte_io.hpp"
+#include "tile_diff.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio> // FILE
+#include <cstring> // memcmp
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <random>
+
+constexpr uint8_t JOURNAL_MAGIC[3] = {'A', 'X', 'J'};
+constexpr uint32_t JOURNAL_MAX_RECORD = 1u << 30;
+
+struct EditJournal::State
+{
+	std::mutex mutex;
+	std::condition_variable idle;
+
+	FILE* file = nullptr;			// Only touched by the write task while writing is set
+	std::vector<uint8_t> pending;	// Records waiting for the next batch
+	bool writing = false;
+
+	~State()
+	{
+		if (file) fclose(file);
+	}
+};
+
+uint64_t makeJournalId()
+{
+	std::random_device rd;
+	uint64_t id = (static_cast<uint64_t>(rd()) << 32) ^ rd() ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+	return id ? id : 1; // 0 means no journal
+}
+
+std::string makeJournalPath(const std::string& map_file, uint64_t base_seq)
+{
+	return map_file + JOURNAL_EXT + "." + std::to_string(base_seq);
+}
+
+bool writeJournalPointer(const std::string& file, const JournalPointer& p)
+{
+	std::string text = p.map_file + "\n" + p.base + "\n";
+	for (const std::string& j : p.journals) text += j + "\n";
+
+	// A crash leaves the old chain or the new one, never half of either
+	const std::string temp = file + ".tmp";
+	FILE* out = fopen(temp.c_str(), "wb");
+	bool ok = out && fwrite(text.data(), 1, text.size(), out) == text.size() && syncFile(out);
+	if (out) ok = fclose(out) == 0 && ok;
+
+	std::error_code ec;
+	if (ok) std::filesystem::rename(temp, file, ec);
+
+	if (!ok || ec)
+	{
+		std::cerr << "Failed to write journal pointer: " << file << std::endl;
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+
+	syncDirectory(std::filesystem::path(file).parent_path().string());
+
+	return true;
+}
+
+bool readJournalPointer(const std::string& file, JournalPointer& p)
+{
+	std::ifstream in(file);
+	if (!in) return false;
+
+	p = JournalPointer();
+	std::getline(in, p.map_file);
+	std::getline(in, p.base);
+	for (std::string line; std::getline(in, line);)
+	{
+		if (!line.empty()) p.journals.push_back(line);
+	}
+
+	return !p.map_file.empty() && !p.base.empty() && !p.journals.empty();
+}
+
+static bool applyRecord(ByteReader r, Map& m)
+{
+	uint8_t op = r.u8();
+	bool show = r.u8() != 0;
+
+	switch (op)
+	{
+		case JOURNAL_TILES:
+		{
+			uint64_t count = r.varint();
+			if (!r.ok || count > r.size - r.pos) return false; // At least a byte per tile
+
+			std::vector<vec2i> positions(static_cast<size_t>(count));
+			for (vec2i& p : positions)
+			{
+				p.x = static_cast<int>(r.varint());
+				p.y = static_cast<int>(r.varint());
+			}
+			if (!r.ok) return false;
+
+			for (const vec2i& p : positions) setTile(m, p, show);
+		}
+		return true;
+
+		case JOURNAL_RECT:
+		{
+			vec2i tl, br;
+			tl.x = static_cast<int>(r.varint());
+			tl.y = static_cast<int>(r.varint());
+			br.x = static_cast<int>(r.varint());
+			br.y = static_cast<int>(r.varint());
+			if (!r.ok || !m.v_tiles.clip(tl, br)) return false;
+
+			setTileRect(m, tl, br, show);
+		}
+		return true;
+
+		case JOURNAL_PASTE:
+		{
+			vec2i tl;
+			tl.x = static_cast<int>(r.varint());
+			tl.y = static_cast<int>(r.varint());
+			uint64_t w = r.varint();
+			uint64_t h = r.varint();
+			if (!r.ok || w == 0 || h == 0 || w > static_cast<uint64_t>(m.width) || h > static_cast<uint64_t>(m.height)) return false;
+
+			TileBitset tiles(static_cast<int>(w), static_cast<int>(h));
+			if (!readTileRuns(r, tiles)) return false;
+
+			setTiles(m, tl, tiles);
+		}
+		return true;
+
+		default:
+			std::cerr << "Unknown journal operation: " << static_cast<int>(op) << std::endl;
+		return false;
+	}
+}
+
+int replayJournal(const std::string& file, Map& m)
+{
+	MappedFile mapped;
+	if (!mapped.open(file) || mapped.size() < JOURNAL_HEADER_SIZE) return 0;
+
+	const uint8_t* bytes = mapped.data();
+	ByteReader header(bytes, mapped.size());
+	header.bytes(3);
+	uint16_t version = header.u16();
+	header.bytes(3);
+	uint64_t id = header.u64();
+	header.u64(); // Base sequence, records carry their own
+	header.bytes(4);
+	uint32_t header_crc = header.u32();
+
+	if (memcmp(bytes, JOURNAL_MAGIC, 3) != 0 || version != JOURNAL_VERSION || crc32(bytes, 28) != header_crc)
+	{
+		std::cerr << "Not an edit journal: " << file << std::endl;
+		return 0;
+	}
+
+	// A journal left by another map, or by this one before it was saved again elsewhere
+	if (id == 0 || id != m.journal_id) return 0;
+
+	int applied = 0;
+	ByteReader r(bytes + JOURNAL_HEADER_SIZE, mapped.size() - JOURNAL_HEADER_SIZE);
+
+	while (r.pos < r.size)
+	{
+		uint32_t payload_sz = r.u32();
+		uint32_t payload_crc = r.u32();
+		const uint8_t* payload = r.ok && payload_sz <= JOURNAL_MAX_RECORD ? r.bytes(payload_sz) : nullptr;
+
+		if (!payload || crc32(payload, payload_sz) != payload_crc) break; // Torn write at the end
+
+		ByteReader record(payload, payload_sz);
+		uint64_t seq = record.u64();
+		if (!record.ok) break;
+
+		// Edits the save already has are skipped, a gap means the rest belongs to something else
+		if (seq <= m.journal_seq) continue;
+		if (seq != m.journal_seq + 1) break;
+
+		if (!applyRecord(record, m))
+		{
+			std::cerr << "Bad edit journal record " << seq << " in " << file << std::endl;
+			break;
+		}
+
+		m.journal_seq = seq;
+		++applied;
+	}
+
+	return applied;
+}
+
+EditJournal::EditJournal() : state(std::make_shared<State>())
+{
+}
+
+EditJournal::~EditJournal()
+{
+	close();
+}
+
+bool EditJournal::open(const std::string& file, uint64_t id, uint64_t base_seq)
+{
+	close();
+
+	ByteWriter w;
+	w.bytes(JOURNAL_MAGIC, 3);
+	w.u16(JOURNAL_VERSION);
+	w.buf.resize(8, 0);
+	w.u64(id);
+	w.u64(base_seq);
+	w.buf.resize(28, 0);
+	w.u32(crc32(w.buf.data(), 28));
+
+	// Synced before anything is appended, a save is never followed by a journal that predates it
+	FILE* f = fopen(file.c_str(), "wb");
+	bool ok = f && fwrite(w.buf.data(), 1, w.buf.size(), f) == w.buf.size() && syncFile(f);
+	if (!ok)
+	{
+		std::cerr << "Failed to start edit journal: " << file << std::endl;
+		if (f) fclose(f);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(state->mutex);
+	state->file = f;
+	path = file;
+	size = w.buf.size();
+
+	return true;
+}
+
+void EditJournal::close()
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->idle.wait(lock, [this]() { return !state->writing; });
+
+	if (state->file) fclose(state->file);
+	state->file = nullptr;
+	state->pending.clear();
+
+	path.clear();
+	size = 0;
+}
+
+void EditJournal::queue(const std::vector<uint8_t>& payload)
+{
+	ByteWriter w;
+	w.u32(static_cast<uint32_t>(payload.size()));
+	w.u32(crc32(payload.data(), payload.size()));
+	size += w.buf.size() + payload.size();
+
+	std::lock_guard<std::mutex> lock(state->mutex);
+	state->pending.insert(state->pending.end(), w.buf.begin(), w.buf.end());
+	state->pending.insert(state->pending.end(), payload.begin(), payload.end());
+
+	if (state->writing) return; // Picked up by the running task
+
+	state->writing = true;
+	std::shared_ptr<State> s = state;
+	getWorkerPool().submit([s]()
+	{
+		std::vector<uint8_t> batch;
+		for (;;)
+		{
+			{
+				std::lock_guard<std::mutex> lock(s->mutex);
+				batch.clear();
+				batch.swap(s->pending);
+
+				if (batch.empty())
+				{
+					s->writing = false;
+					s->idle.notify_all();
+					return;
+				}
+			}
+
+			if (fwrite(batch.data(), 1, batch.size(), s->file) != batch.size() || !syncFile(s->file))
+			{
+				std::cerr << "Failed to write edit journal" << std::endl;
+			}
+		}
+	});
+}
+
+void EditJournal::logTiles(Map& m, const std::vector<vec2i>& positions, bool show)
+{
+	if (!isOpen()) return;
+
+	ByteWriter w;
+	w.u64(++m.journal_seq);
+	w.u8(JOURNAL_TILES);
+	w.u8(show);
+
+	// Tiles off the map don't do anything, so they aren't recorded
+	uint64_t count = 0;
+	for (const vec2i& p : positions) count += m.v_tiles.inBounds(p.x, p.y);
+
+	w.varint(count);
+	for (const vec2i& p : positions)
+	{
+		if (!m.v_tiles.inBounds(p.x, p.y)) continue;
+		w.varint(p.x);
+		w.varint(p.y);
+	}
+
+	queue(w.buf);
+}
+
+void EditJournal::logRect(Map& m, vec2i tl, vec2i br, bool show)
+{
+	if (!isOpen() || !m.v_tiles.clip(tl, br)) return;
+
+	ByteWriter w;
+	w.u64(++m.journal_seq);
+	w.u8(JOURNAL_RECT);
+	w.u8(show);
+	w.varint(tl.x);
+	w.varint(tl.y);
+	w.varint(br.x);
+	w.varint(br.y);
+
+	queue(w.buf);
+}
+
+void EditJournal::logPaste(Map& m, vec2i tl, const TileBitset& tiles)
+{
+	if (!isOpen() || tiles.empty() || tl.x < 0 || tl.y < 0) return;
+
+	ByteWriter w;
+	w.u64(++m.journal_seq);
+	w.u8(JOURNAL_PASTE);
+	w.u8(0);
+	w.varint(tl.x);
+	w.varint(tl.y);
+	w.varint(tiles.width());
+	w.varint(tiles.height());
+	writeTileRuns(w, tiles);
+
+	queue(w.buf);
+}
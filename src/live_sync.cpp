@@ -0,0 +1,116 @@
+#include "live_sync.hpp"
+
+#include <algorithm> // std::max
+
+LiveSync::LiveSync(std::shared_ptr<TileSnapshotChannel> snapshots, size_t capacity) : ring(capacity), snapshots(snapshots)
+{
+}
+
+void LiveSync::push(vec2i tl, vec2i br, bool show)
+{
+	VisibilityDelta d;
+	d.seq = ++sequence;
+	d.tl = tl;
+	d.br = br;
+	d.show = show;
+	d.time = commit_time;
+
+	// Once one is dropped the rest of the command goes too, the snapshot covers them all
+	if (overflowed || !ring.push(d)) overflowed = true;
+}
+
+// Published before the next delta can be pushed, so the viewer always finds it when it reaches the gap
+void LiveSync::finish(const Map& m)
+{
+	if (!overflowed) return;
+
+	snapshots->publish(m, sequence);
+	overflowed = false;
+}
+
+void LiveSync::sendSpans(const Map& m, const TileDiff& tiles, bool show)
+{
+	commit_time = std_clk::now();
+
+	tiles.forEachSpan([&](int y, int x0, int x1)
+	{
+		vec2i a(x0, y), b(x1, y);
+		if (m.v_tiles.clip(a, b)) push(a, b, show);
+	});
+
+	finish(m);
+}
+
+void LiveSync::sendRect(const Map& m, vec2i tl, vec2i br, bool show)
+{
+	commit_time = std_clk::now();
+
+	if (m.v_tiles.clip(tl, br)) push(tl, br, show);
+
+	finish(m);
+}
+
+void LiveSync::sendPaste(const Map& m, vec2i tl, const TileBitset& tiles)
+{
+	commit_time = std_clk::now();
+
+	for (int y = 0; y < tiles.height(); ++y)
+	{
+		int x = 0;
+		bool value = false;
+		while (x < tiles.width())
+		{
+			int end = tiles.findSpan(y, x, tiles.width() - 1, !value);
+			if (end > x)
+			{
+				vec2i a(tl.x + x, tl.y + y), b(tl.x + end - 1, tl.y + y);
+				if (m.v_tiles.clip(a, b)) push(a, b, value);
+			}
+
+			x = end;
+			value = !value;
+		}
+	}
+
+	finish(m);
+}
+
+bool LiveSync::takeSnapshot(Map& m, std::shared_ptr<const TileSnapshot>& applied)
+{
+	// One behind the deltas already applied would undo them
+	std::shared_ptr<const TileSnapshot> snap = snapshots->latest();
+	if (!snap || snap == applied || snap->delta_seq < received || !applyTileSnapshot(m, *snap, applied.get())) return false;
+
+	if (snap->delta_seq > received) ++resyncs;
+
+	applied = snap;
+	received = std::max(received, snap->delta_seq);
+	return true;
+}
+
+int LiveSync::receive(Map& m, std::shared_ptr<const TileSnapshot>& applied, std_clk::time_point& oldest)
+{
+	// Sent with U, or published by the editor after the ring filled up
+	takeSnapshot(m, applied);
+
+	int count = 0;
+	VisibilityDelta d;
+	while (ring.pop(d))
+	{
+		if (d.seq <= received) continue; // Already in the snapshot
+
+		// The missing ones were dropped, the snapshot that has them was published before this was pushed
+		if (d.seq != received + 1)
+		{
+			takeSnapshot(m, applied);
+			if (d.seq <= received) continue;
+		}
+
+		setTileRect(m, d.tl, d.br, d.show);
+		received = d.seq;
+
+		if (count++ == 0) oldest = d.time;
+	}
+
+	return count;
+}
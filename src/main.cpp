@@ -18,6 +18,7 @@
 
 #include <iostream> // For std::cout and std::Cerr
 #include <chrono>	// To calculate delta time between ticks
+#include <algorithm> // std::max
 
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_font.h>
@@ -33,10 +34,13 @@
 #include "viewer.hpp"
 #include "map_editor.hpp"
 #include "editor_events.hpp"
+#include "texture_budget.hpp"
 
 constexpr int 	DEFAULT_WIND_WIDTH	= 1280;
 constexpr int 	DEFAULT_WIND_HEIGHT	= 768;
 constexpr char 	DISPLAY_TITLE[]		= "Axe DnD Map";
+constexpr int	REDRAW_FRAMES		= 2;	// Frames drawn per invalidation, ImGui lays out new windows a frame late
+constexpr double LOOP_STATS_PERIOD	= 1.0;	// Seconds between wakeup and CPU samples
 
 using std_clk = std::chrono::steady_clock;
 
@@ -66,6 +70,7 @@ int main()
 	ALLEGRO_DISPLAY*		display			= nullptr;
 	ALLEGRO_EVENT_QUEUE*	ev_queue		= nullptr;
 	ALLEGRO_TIMER*			timer			= nullptr;
+	ALLEGRO_TIMER*			autosave_timer	= nullptr;
 	ALLEGRO_THREAD*			viewer_thread	= nullptr;
 	ALLEGRO_EVENT			ev;
 
@@ -75,9 +80,15 @@ int main()
 	bool file_dialog_open = false;
 	AsyncDialog *file_dialog = nullptr;
 
-	bool redraw = true;
+	int redraw_frames = REDRAW_FRAMES;
 	bool quit = false;
 
+	// Idle measurements, sampled every LOOP_STATS_PERIOD
+	int wakeups = 0;
+	int frames = 0;
+	auto stats_time = std_clk::now();
+	double stats_cpu = getProcessCpuTime();
+
 	display = createDisplay(std::string(DISPLAY_TITLE) + " - Editor", DEFAULT_WIND_WIDTH, DEFAULT_WIND_HEIGHT, ALLEGRO_WINDOWED | ALLEGRO_RESIZABLE);
 	
 	al_init_image_addon();
@@ -87,6 +98,7 @@ int main()
 	al_init_native_dialog_addon();
 
 	timer = al_create_timer(1.0 / 60.0);
+	autosave_timer = al_create_timer(AUTOSAVE_DEFAULT_INTERVAL);
 	ev_queue = al_create_event_queue();
 
 	// Systems
@@ -97,31 +109,96 @@ int main()
 	al_register_event_source(ev_queue, al_get_keyboard_event_source());
 	al_register_event_source(ev_queue, al_get_mouse_event_source());
 	al_register_event_source(ev_queue, al_get_timer_event_source(timer));
+	al_register_event_source(ev_queue, al_get_timer_event_source(autosave_timer));
 	al_register_event_source(ev_queue, al_get_display_event_source(display));
 	al_register_event_source(ev_queue, gui.getEventSource());
 	al_register_event_source(ev_queue, map_editor.getEventSource());
 
+	gui.setBundleMaps(map_editor.getBundleMaps());
+	al_start_timer(autosave_timer);
+	map_editor.recover();
+
 	ViewerArgs viewer_args;
 	viewer_args.event_source = map_editor.getEventSource();
+	viewer_args.live_sync = map_editor.getLiveSync();
 	viewer_args.display_title = std::string(DISPLAY_TITLE) + " - Viewer";
 	viewer_args.display_size = { DEFAULT_WIND_WIDTH, DEFAULT_WIND_HEIGHT };
 
-	// Set program lifetime keybinds
-	m_input.setKeybind(ALLEGRO_KEY_ESCAPE, 	[&quit](){ quit = true; });
-	m_input.setKeybind(ALLEGRO_KEY_F1,		[&](){
-		al_destroy_thread(viewer_thread); // Safely returns null if viewer_thread passed in is null
+	// Set program lifetime keybinds, then let keybinds.cfg override them and the editor's
+	m_input.loadBindings("quit = escape\nopen_viewer = f1\n", "program bindings");
+	m_input.loadBindingsFile(KEYBINDS_PATH);
+	m_input.setAction("quit", [&quit](){ quit = true; });
+	// The viewer sleeps until it has something to draw, so it is woken to notice it should stop
+	auto stopViewer = [&]() {
+		if (!viewer_thread) return;
+
+		al_set_thread_should_stop(viewer_thread);
+		map_editor.fireEvent(AXE_EDITOR_EVENT_WAKE_VIEWER);
+		al_destroy_thread(viewer_thread);
 		viewer_thread = nullptr;
+	};
+
+	m_input.setAction("open_viewer", [&](){
+		stopViewer();
+
+		viewer_args.image_path = map_editor.getImagePath();
+		viewer_args.image = map_editor.getDecodedImage();
+		viewer_args.tile_size = map_editor.getTileSize();
+		viewer_args.start_time = std_clk::now();
 
 		viewer_thread = al_create_thread(viewer_thread_func, &viewer_args);
 		al_start_thread(viewer_thread);
 		map_editor.fireEvent(AXE_EDITOR_EVENT_COPY_DATA);	
 	});
 
-	al_start_timer(timer);
+	// Nothing is drawn unless something invalidated the frame. The timer only
+	// runs while the editor animates, otherwise the loop sleeps in al_wait_for_event.
 	auto last_time = std_clk::now();
 	while (!quit)
 	{
+		if (redraw_frames > 0 && al_event_queue_is_empty(ev_queue))
+		{
+			al_clear_to_color(al_map_rgb(0, 0, 0));
+			map_editor.draw();
+			gui.setImportStatus(map_editor.isImporting(), map_editor.getImportProgress(), map_editor.getImportStage());
+			gui.setTextureStats(getTextureBudgetStats());
+			AutosaveStats autosave_stats = map_editor.getAutosaveStats();
+			gui.setAutosaveStats(autosave_stats.capture_time, autosave_stats.write_time, autosave_stats.saves);
+			gui.setUndoStats(map_editor.getUndoMemory(), map_editor.getUndoSteps(), map_editor.getHistoryCursor());
+			gui.render();
+			al_flip_display();
+
+			++frames;
+			--redraw_frames;
+			continue;
+		}
+
+		// Checked before blocking, so work started outside an event (the import recover() starts) gets its ticks
+		bool animating = map_editor.isAnimating();
+		if (animating && !al_get_timer_started(timer))
+		{
+			last_time = std_clk::now(); // The first tick shouldn't see the idle time as delta
+			al_start_timer(timer);
+		}
+		else if (!animating && al_get_timer_started(timer))
+		{
+			al_stop_timer(timer);
+		}
+
 		al_wait_for_event(ev_queue, &ev);
+		++wakeups;
+
+		double stats_elapsed = std::chrono::duration<double>(std_clk::now() - stats_time).count();
+		if (stats_elapsed >= LOOP_STATS_PERIOD)
+		{
+			double cpu = getProcessCpuTime();
+			gui.setLoopStats(wakeups / stats_elapsed, frames / stats_elapsed, 100.0 * (cpu - stats_cpu) / stats_elapsed);
+
+			wakeups = 0;
+			frames = 0;
+			stats_time = std_clk::now();
+			stats_cpu = cpu;
+		}
 
 		// Skip any events where the focus is the view display
 		if (ev.any.source == al_get_mouse_event_source())
@@ -194,46 +271,89 @@ int main()
 			break;
 
 			case AXE_GUI_EVENT_NEW_MAP:
-				if (map_editor.create(gui.getFileBufferText(), static_cast<int>(ev.user.data2)))
+				map_editor.create(gui.getFileBufferText(), static_cast<int>(ev.user.data2));
+			break;
+
+			case AXE_GUI_EVENT_CANCEL_IMPORT:
+				map_editor.cancelImport();
+			break;
+
+			case AXE_GUI_EVENT_SET_TEXTURE_BUDGET:
+				setTextureBudget(static_cast<uint64_t>(ev.user.data1) << 20);
+			break;
+
+			case AXE_GUI_EVENT_SET_RENDER_MODE:
+				setMapRenderMode(ev.user.data1 ? RENDER_FOG_MASK : RENDER_TILES);
+			break;
+
+			case AXE_GUI_EVENT_SET_RENDER_CACHE:
+				setMapRenderCache(ev.user.data1);
+			break;
+
+			case AXE_GUI_EVENT_SAVE_TO_BUNDLE:
+				map_editor.saveToBundle(ev.user.data1);
+				gui.setBundleMaps(map_editor.getBundleMaps());
+			break;
+
+			case AXE_GUI_EVENT_OPEN_BUNDLE_MAP:
+				map_editor.loadFromBundle(gui.getBundleMap(static_cast<int>(ev.user.data1)));
+			break;
+
+			case AXE_GUI_EVENT_SET_LIVE_SYNC:
+				map_editor.setLiveSync(ev.user.data1);
+			break;
+
+			case AXE_GUI_EVENT_JUMP_HISTORY:
+				map_editor.jumpToHistory(static_cast<size_t>(ev.user.data1));
+			break;
+
+			case AXE_GUI_EVENT_SET_UNDO_BUDGET:
+				map_editor.setUndoBudget(static_cast<size_t>(ev.user.data1) << 20);
+			break;
+
+			case AXE_GUI_EVENT_SET_AUTOSAVE:
+				map_editor.setAutosaveGenerations(static_cast<int>(ev.user.data2));
+				if (ev.user.data1 > 0)
 				{
-					viewer_args.image_path = gui.getFileBufferText();
+					al_set_timer_speed(autosave_timer, static_cast<double>(ev.user.data1));
+					al_start_timer(autosave_timer);
+				}
+				else
+				{
+					al_stop_timer(autosave_timer);
 				}
 			break;
 
 			case ALLEGRO_EVENT_TIMER:
+				// The snapshot is cheap, the file is written on a worker
+				if (ev.timer.source == autosave_timer)
+				{
+					map_editor.autosave();
+					break;
+				}
+
 				current_time = std_clk::now();
 				delta_time = std::chrono::duration<double>(current_time - last_time).count();
 				last_time = current_time;
 				map_editor.update(delta_time);
-				redraw = true;
+				redraw_frames = std::max(redraw_frames, 1);
 			break;
 
 			default:
 			break;
 		}
-		
-		//Drawing
 
-		if (al_event_queue_is_empty(ev_queue) && redraw)
-		{
-			
-			al_clear_to_color(al_map_rgb(0, 0, 0));
-			map_editor.draw();
-			gui.render();
-			al_flip_display();
-
-			redraw = false;
-		}
+		// Anything but a tick can change what is on screen
+		if (ev.type != ALLEGRO_EVENT_TIMER) redraw_frames = REDRAW_FRAMES;
 	}
 
-	if (viewer_thread) al_set_thread_should_stop(viewer_thread);
+	stopViewer();
 
 	//Cleanup Allegro5
 	al_destroy_timer(timer);
+	al_destroy_timer(autosave_timer);
 	al_destroy_event_queue(ev_queue);
 	al_destroy_display(display);
 
-	al_destroy_thread(viewer_thread);
-
 	return 0;
 }
@@ -1,47 +1,108 @@
 #include "map.hpp"
+#include "mdf.hpp"
+#include "bundle.hpp"
 
 #include <iostream> // for debugging
 #include <iomanip>
 #include <fstream>
-#include <math.h> // floor
+#include <filesystem>
+#include <vector>
+#include <algorithm> // std::min
+#include <atomic>
+#include <math.h> // floor, ceil
 
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_primitives.h>
 
-#define cchar_cast(x) reinterpret_cast<const char*>(&x)
-#define char_cast(x) reinterpret_cast<char*>(&x)
+constexpr int GRID_CACHE_MARGIN = 32;	// Tiles cached past each side of the view
+constexpr double GRID_FADE_START = 12.0;	// On screen tile size in pixels where the grid starts to fade
+constexpr double GRID_FADE_END = 4.0;		// and where it is gone
+constexpr int GRID_FADE_STEPS = 8;
+constexpr int RENDER_CACHE_MARGIN = 256;	// Pixels rendered past each side of the view
 
-constexpr uint8_t MAGIC[] = {'M', 'D', 'F'};
-constexpr uint16_t version = 0x0100;
+static std::atomic<int> render_mode{RENDER_FOG_MASK};
+static std::atomic<bool> render_cache_enabled{true};
+static std::atomic<uint64_t> last_edit_stamp{0}; // Shared by every map, so a stamp is never reused by the next map loaded
 
 void printFile(std::string path);
 
+void setMapRenderMode(MAP_RENDER_MODE mode)
+{
+	render_mode = mode;
+}
+
+MAP_RENDER_MODE getMapRenderMode()
+{
+	return static_cast<MAP_RENDER_MODE>(render_mode.load());
+}
+
+void setMapRenderCache(bool enabled)
+{
+	render_cache_enabled = enabled;
+}
+
+bool getMapRenderCache()
+{
+	return render_cache_enabled;
+}
+
+static void destroyRenderCache(RenderCache& c)
+{
+	if (c.target) al_destroy_bitmap(c.target);
+	c = RenderCache();
+}
+
+// Rows [y0, y1] changed, clamped to the map
+static void markRowsDirty(Map& m, int y0, int y1)
+{
+	m.row_stamps.resize(m.height, 0);
+	m.edit_stamp = ++last_edit_stamp;
+
+	m.dirty_blocks.resize((m.height + MDF_BLOCK_ROWS - 1) / MDF_BLOCK_ROWS, false);
+
+	y0 = std::max(y0, 0);
+	y1 = std::min(y1, m.height - 1);
+	if (y0 > y1) return;
+
+	for (int y = y0; y <= y1; ++y) m.row_stamps[y] = m.edit_stamp;
+	for (int b = y0 / MDF_BLOCK_ROWS; b <= y1 / MDF_BLOCK_ROWS; ++b) m.dirty_blocks[b] = true;
+}
+
 bool createMap(Map& m, std::string path, int ts)
 {
-	if (m.bmp != nullptr)
+	if (isMapImageLoaded(m.image))
 	{
 		std::cerr << "Map: " << path << " already loaded." << std::endl;
 		return true;
 	}
 
-	m.bmp = nullptr;
-	m.width = 0;
-	m.height = 0;
-	m.path = path;
-	m.tile_size = ts;
-
-	m.bmp = al_load_bitmap(m.path.c_str());
+	MapImage image;
 
-	if (!m.bmp)
+	if (!loadMapImage(image, path))
 	{
-		std::cerr << "Failed to load image: " << m.path << std::endl;
+		std::cerr << "Failed to load image: " << path << std::endl;
 		return false;
 	}
 
-	m.width = al_get_bitmap_width(m.bmp) / m.tile_size;
-	m.height = al_get_bitmap_height(m.bmp) / m.tile_size;
+	return createMap(m, image, path, ts);
+}
+
+bool createMap(Map& m, MapImage& image, std::string path, int ts)
+{
+	if (!isMapImageLoaded(image) || ts <= 0) return false;
+
+	destroyMapImage(m.image);
+	m.image = image;
+	image = MapImage();
+
+	m.path = path;
+	m.tile_size = ts;
+	m.width = m.image.width / m.tile_size;
+	m.height = m.image.height / m.tile_size;
 
-	m.v_tiles.resize(m.width * m.height, false);
+	m.v_tiles.assign(m.width, m.height, false);
+	markRowsDirty(m, 0, m.height - 1);
+	m.grid = GridCache();
 
 	m.needs_save = false;
 
@@ -50,11 +111,7 @@ bool createMap(Map& m, std::string path, int ts)
 
 void destroyMap(Map& m)
 {
-	if (m.bmp)
-	{
-		al_destroy_bitmap(m.bmp);
-		m.bmp = nullptr;
-	}
+	destroyMapImage(m.image);
 
 	m.width = 0;
 	m.height = 0;
@@ -63,161 +120,334 @@ void destroyMap(Map& m)
 	m.needs_save = false;
 
 	m.v_tiles.clear();
+	m.row_stamps.clear();
+	m.dirty_blocks.clear();
+	m.saved_file.clear();
+	m.journal_id = 0;
+	m.journal_seq = 0;
+	destroyFogMask(m.fog);
+	destroyRenderCache(m.render_cache);
+	m.grid = GridCache();
 }
 
 bool reloadMap(Map& m)
 {
-	if (m.bmp)
-	{
-		al_destroy_bitmap(m.bmp);
-		m.bmp = nullptr;
-	}
+	destroyMapImage(m.image);
 
 	return createMap(m, m.path, m.tile_size);
 }
 
 bool saveMap(Map& m, std::string file, const View::ViewPort& v)
 {
-	//TODO Make this little-endian
-	/*	File Format
-		Data to Save:
-			path to map image
-			width
-			height
-			tile_size
-			tile vector
+	MapFileInfo info;
+	info.image_path = m.path;
+	info.width = m.width;
+	info.height = m.height;
+	info.tile_size = m.tile_size;
+	info.view_pos = v.world_pos;
+	info.view_scale = v.scale;
+	info.journal_id = m.journal_id;
+	info.journal_seq = m.journal_seq;
+
+	// Appending only works on the file this map was last saved to or loaded from, anything else is rewritten
+	bool saved = file == m.saved_file && appendMapFile(file, info, m.v_tiles, m.dirty_blocks, m.saved_file_size);
+	if (!saved && !writeMapFile(file, info, m.v_tiles)) return false;
+
+	std::error_code ec;
+	m.saved_file = file;
+	m.saved_file_size = std::filesystem::file_size(file, ec);
+	if (ec) m.saved_file.clear();
+	std::fill(m.dirty_blocks.begin(), m.dirty_blocks.end(), false);
 
-			view position
-			view scale
-	*/
+	m.needs_save = false;
+	return true;
+}
 
-	std::ofstream out(file, std::ofstream::out | std::ofstream::binary);
+// Swaps a map read from a file or bundle into m
+static void applyLoadedMap(Map& m, const MapFileInfo& info, TileBitset& tiles, View::ViewPort& v)
+{
+	Map temp_map;
+	temp_map.v_tiles = std::move(tiles);
+	temp_map.path = info.image_path;
+	temp_map.width = info.width;
+	temp_map.height = info.height;
+	temp_map.tile_size = info.tile_size;
+	temp_map.journal_id = info.journal_id;
+	temp_map.journal_seq = info.journal_seq;
+
+	temp_map.image = m.image;
+	if (!isMapImageLoaded(temp_map.image)) loadMapImage(temp_map.image, temp_map.path);
+	destroyFogMask(m.fog);
+	destroyRenderCache(m.render_cache);
+	m = temp_map;
+	markRowsDirty(m, 0, m.height - 1);
+	v.scale = info.view_scale;
+	v.world_pos = info.view_pos;
+
+	m.saved_file.clear();
+	std::fill(m.dirty_blocks.begin(), m.dirty_blocks.end(), false);
+	m.needs_save = false;
+}
 
-	if (out.is_open())
-	{
-		//Write Magic Bits to identify file
-		out.write(cchar_cast(MAGIC), sizeof(char)*3);
-		//Write version of file
-		out.write(cchar_cast(version), sizeof(version));
-
-		//Write View position and scale
-		out.write(cchar_cast(v.world_pos), sizeof(v.world_pos));
-		out.write(cchar_cast(v.scale), sizeof(v.scale));
-
-		//Write size of path, then path
-		size_t path_sz = m.path.size();
-		out.write(char_cast(path_sz), sizeof(path_sz));
-		out.write(m.path.c_str(), path_sz);
-
-		//Write Map data
-		out.write(cchar_cast(m.width), sizeof(m.width));
-		out.write(cchar_cast(m.height), sizeof(m.height));
-		out.write(cchar_cast(m.tile_size), sizeof(m.tile_size));
-		std::copy(m.v_tiles.begin(), m.v_tiles.end(), std::ostreambuf_iterator<char>(out));
-		//out.write(reinterpret_cast<const char *>(m.v_tiles[0]), m.v_tiles.size() * sizeof(bool));
-
-		out.close();
-
-		m.needs_save = false;
-		return true;
-	}
+// Newer saves can append to what was just read, an 0x0100 file gets rewritten
+static void setSavedFile(Map& m, const std::string& file, const MapFileInfo& info)
+{
+	std::error_code ec;
+	m.saved_file = info.version == MDF_VERSION_2 ? file : "";
+	m.saved_file_size = std::filesystem::file_size(file, ec);
+	if (ec) m.saved_file.clear();
+}
 
-	return false;
+bool createMap(Map& m, MapImage& image, const std::string& file, const MapFileInfo& info, TileBitset& tiles, View::ViewPort& v)
+{
+	if (!isMapImageLoaded(image) || tiles.width() != info.width || tiles.height() != info.height) return false;
+
+	destroyMapImage(m.image);
+	m.image = image;
+	image = MapImage();
+
+	applyLoadedMap(m, info, tiles, v);
+	if (!file.empty()) setSavedFile(m, file, info);
+
+	return true;
 }
 
 bool loadMap(Map& m, std::string file, View::ViewPort &v)
 {
-	View::ViewPort temp_view;
-	Map temp_map;
+	MapFileInfo info;
+	TileBitset tiles;
 
-	std::ifstream in(file, std::ifstream::binary);
+	if (!readMapFile(file, info, tiles)) return false;
 
-	if (in.is_open())
-	{
-		uint8_t buf[3];
-		uint16_t r_version = 0;
+	applyLoadedMap(m, info, tiles, v);
+	setSavedFile(m, file, info);
 
-		in.read(char_cast(buf), sizeof(char) * 3);
-		in.read(char_cast(r_version), sizeof(r_version));
+	return true;
+}
 
-		bool correct_file = true;
+bool loadMapFromBundle(Map& m, const std::string& bundle, const std::string& name, View::ViewPort& v)
+{
+	Bundle b;
+	MapFileInfo info;
+	TileBitset tiles;
 
-		for (int i = 0; i < 3; ++i)
-		{
-			if (buf[i] != MAGIC[i]) correct_file = false;
-		}
+	if (!openBundle(b, bundle) || !readBundleMap(b, name, info, tiles)) return false;
 
-		if (correct_file && version == r_version)
-		{
-			in.read(char_cast(temp_view.world_pos), sizeof(temp_view.world_pos));
-			in.read(char_cast(temp_view.scale), sizeof(temp_view.scale));
+	// The image is read lazily through info.image_path, the table of contents isn't needed anymore
+	closeBundle(b);
+	applyLoadedMap(m, info, tiles, v);
+
+	return true;
+}
 
-			size_t path_sz = 0;
-			in.read(char_cast(path_sz), sizeof(path_sz));
+bool saveMapToBundle(Map& m, const std::string& bundle, const std::string& name, const View::ViewPort& v, bool embed_decoded)
+{
+	MapFileInfo info;
+	info.image_path = m.path;
+	info.width = m.width;
+	info.height = m.height;
+	info.tile_size = m.tile_size;
+	info.view_pos = v.world_pos;
+	info.view_scale = v.scale;
 
-			char path_buf[path_sz];
-			in.read(path_buf, sizeof(char) * path_sz);
-			temp_map.path = std::string(path_buf);
+	if (!writeBundleMap(bundle, name, info, m.v_tiles, embed_decoded)) return false;
 
-			in.read(char_cast(temp_map.width), sizeof(temp_map.width));
-			in.read(char_cast(temp_map.height), sizeof(temp_map.height));
-			in.read(char_cast(temp_map.tile_size), sizeof(temp_map.tile_size));
+	m.needs_save = false;
+	return true;
+}
 
-			temp_map.v_tiles = std::vector<bool>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+// 0 when tiles are too small on screen for the grid to help, GRID_FADE_STEPS at full strength
+static int getGridFadeStep(const Map& m, const View::ViewPort& v)
+{
+	double px = m.tile_size * v.scale;
+	double t = std::max(0.0, std::min(1.0, (px - GRID_FADE_END) / (GRID_FADE_START - GRID_FADE_END)));
 
-			temp_map.bmp = m.bmp;
-			if (m.bmp == nullptr) temp_map.bmp = al_load_bitmap(temp_map.path.c_str());
-			m = temp_map;
-			v.scale = temp_view.scale;
-			v.world_pos = temp_view.world_pos;
+	return static_cast<int>(t * GRID_FADE_STEPS + 0.5);
+}
 
-			m.needs_save = false;
-			return true;
-		}
+static void updateGridCache(Map& m, const vec2i& vis_tl, const vec2i& vis_br, int fade_step)
+{
+	GridCache& g = m.grid;
 
-		in.close();
+	bool covered = vis_tl.x >= g.tl.x && vis_tl.y >= g.tl.y && vis_br.x <= g.br.x && vis_br.y <= g.br.y;
+	if (covered && g.tile_size == m.tile_size && g.fade_step == fade_step) return;
+
+	g.tile_size = m.tile_size;
+	g.fade_step = fade_step;
+	g.tl = vec2i(std::max(vis_tl.x - GRID_CACHE_MARGIN, 0), std::max(vis_tl.y - GRID_CACHE_MARGIN, 0));
+	g.br = vec2i(std::min(vis_br.x + GRID_CACHE_MARGIN, m.width - 1), std::min(vis_br.y + GRID_CACHE_MARGIN, m.height - 1));
+
+	ALLEGRO_COLOR col = al_premul_rgba(40, 40, 40, static_cast<unsigned char>(255 * fade_step / GRID_FADE_STEPS));
+	View::clearBatch(g.lines, 1.0);
+
+	for (int y = g.tl.y; y <= g.br.y + 1; ++y)
+	{
+		View::addLine(g.lines, vec2d(g.tl.x * m.tile_size, y * m.tile_size), vec2d((g.br.x + 1) * m.tile_size, y * m.tile_size), col);
 	}
 
-	return false;
+	for (int x = g.tl.x; x <= g.br.x + 1; ++x)
+	{
+		View::addLine(g.lines, vec2d(x * m.tile_size, g.tl.y * m.tile_size), vec2d(x * m.tile_size, (g.br.y + 1) * m.tile_size), col);
+	}
 }
 
-void drawMap(const Map& m, const View::ViewPort& v, bool draw_grid, bool show_hidden)
+// Draws everything from scratch, into whatever the target bitmap is
+static void composeMap(Map& m, const View::ViewPort& v, bool draw_grid, bool show_hidden)
 {
+	// Per thread, the editor and viewer each draw their own map. Kept across
+	// frames so a steady view doesn't allocate.
+	static thread_local View::QuadBatch fog_batch;
+
 	vec2i vis_tl, vis_br;
 	getVisibleTileRect(m, v, vis_tl, vis_br);
 
-	al_hold_bitmap_drawing(true);
 	char back_col = 18;
 
-	for (int x = vis_tl.x; x <= vis_br.x; ++x)
+	// Only whole tiles are drawn, so the image is clipped to the visible tile rect
+	drawMapImage(m.image, v, vec2d(vis_tl * m.tile_size), vec2d((vis_br + vec2i{1, 1}) * m.tile_size));
+
+	// The translucent overlay gives the same result as the old 100/255 tint over the black clear
+	ALLEGRO_COLOR fog = show_hidden ? al_map_rgba(0, 0, 0, 155) : al_map_rgb(back_col, back_col, back_col);
+
+	if (getMapRenderMode() == RENDER_FOG_MASK && updateFogMask(m.fog, m.v_tiles, m.row_stamps, m.edit_stamp))
+	{
+		drawFogMask(m.fog, v, m.tile_size, vis_tl, vis_br, fog);
+	}
+	else
 	{
+		// One quad per horizontal run of hidden tiles, row by row the way the bitset is stored
+		View::clearBatch(fog_batch);
+
 		for (int y = vis_tl.y; y <= vis_br.y; ++y)
 		{
-			if (m.v_tiles[y * m.width + x]) View::drawBitmapRegion(v, m.bmp, vec2d(x * m.tile_size, y * m.tile_size), vec2d(m.tile_size, m.tile_size), vec2d(x * m.tile_size, y * m.tile_size), 0);
-			else if (show_hidden) View::drawTintedBitmapRegion(v, m.bmp, vec2d(x * m.tile_size, y * m.tile_size), vec2d(m.tile_size, m.tile_size), vec2d(x * m.tile_size, y * m.tile_size), al_map_rgba(100, 100, 100, 100), 0);
-			else
+			int x = m.v_tiles.findSpan(y, vis_tl.x, vis_br.x, false);
+
+			while (x <= vis_br.x)
 			{
-				vec2d top_left(x * m.tile_size, y * m.tile_size);
-				vec2d bottom_right = top_left + vec2d(m.tile_size, m.tile_size);
-				View::drawFilledRectangle(v, top_left, bottom_right, al_map_rgb(back_col, back_col, back_col));
+				int end = m.v_tiles.findSpan(y, x, vis_br.x, true);
+				View::addQuad(fog_batch, vec2d(x * m.tile_size, y * m.tile_size), vec2d(end * m.tile_size, (y + 1) * m.tile_size), fog);
+				x = m.v_tiles.findSpan(y, end, vis_br.x, false);
 			}
 		}
+
+		View::drawBatch(v, fog_batch);
+	}
+
+	int fade_step = getGridFadeStep(m, v);
+
+	if (draw_grid && fade_step > 0 && vis_tl.x <= vis_br.x && vis_tl.y <= vis_br.y)
+	{
+		updateGridCache(m, vis_tl, vis_br, fade_step);
+		View::drawBatchTransformed(v, m.grid.lines);
+	}
+}
+
+static bool createRenderTarget(RenderCache& c, int w, int h)
+{
+	if (c.target && al_get_bitmap_width(c.target) == w && al_get_bitmap_height(c.target) == h) return true;
+
+	destroyRenderCache(c);
+
+	int old_flags = al_get_new_bitmap_flags();
+
+	// Blitted 1:1, so no filtering
+	al_set_new_bitmap_flags(al_get_current_display() ? ALLEGRO_VIDEO_BITMAP : ALLEGRO_MEMORY_BITMAP);
+	c.target = al_create_bitmap(w, h);
+	al_set_new_bitmap_flags(old_flags);
+
+	return c.target != nullptr;
+}
+
+// Composes the pixel rows [y0, y1) of the cache, or all of it
+static void renderCacheRows(Map& m, RenderCache& c, bool draw_grid, bool show_hidden, int y0, int y1)
+{
+	int w = al_get_bitmap_width(c.target);
+	int h = al_get_bitmap_height(c.target);
+
+	View::ViewPort cv;
+	cv.scale = c.scale;
+	cv.size = vec2i(w, h);
+	cv.screen_pos = vec2i(0, 0);
+	cv.world_pos = c.world_tl + vec2d(w / 2.0 / c.scale, h / 2.0 / c.scale);
+
+	ALLEGRO_BITMAP* old_target = al_get_target_bitmap();
+	al_set_target_bitmap(c.target);
+	al_set_clipping_rectangle(0, y0, w, y1 - y0);
+
+	al_clear_to_color(al_map_rgb(0, 0, 0));
+	composeMap(m, cv, draw_grid, show_hidden);
+
+	al_reset_clipping_rectangle();
+	al_set_target_bitmap(old_target);
+}
+
+void drawMap(Map& m, const View::ViewPort& v, bool draw_grid, bool show_hidden)
+{
+	RenderCache& c = m.render_cache;
+
+	if (!getMapRenderCache())
+	{
+		if (c.target) destroyRenderCache(c);
+		composeMap(m, v, draw_grid, show_hidden);
+		return;
 	}
 
-	al_hold_bitmap_drawing(false);
+	const int w = v.size.x + RENDER_CACHE_MARGIN * 2;
+	const int h = v.size.y + RENDER_CACHE_MARGIN * 2;
 
-	if (draw_grid)
+	if (!createRenderTarget(c, w, h))
 	{
-		for (int x = vis_tl.x; x <= vis_br.x + 1; ++x)
+		composeMap(m, v, draw_grid, show_hidden);
+		return;
+	}
+
+	// View rect in world space, it has to sit inside the cached rect
+	vec2d view_tl = v.world_pos - vec2d(v.size) / 2.0 / v.scale;
+	vec2d view_br = v.world_pos + vec2d(v.size) / 2.0 / v.scale;
+	vec2d cache_br = c.world_tl + vec2d(w, h) / c.scale;
+
+	bool inside = view_tl.x >= c.world_tl.x && view_tl.y >= c.world_tl.y && view_br.x <= cache_br.x && view_br.y <= cache_br.y;
+	bool same = c.scale == v.scale && c.tile_size == m.tile_size && c.mode == getMapRenderMode() && c.draw_grid == draw_grid && c.show_hidden == show_hidden;
+
+	if (!inside || !same || c.stamp == 0)
+	{
+		// Re-centred on the view, snapped to whole pixels
+		c.scale = v.scale;
+		c.world_tl = vec2d(floor(view_tl.x * v.scale) - RENDER_CACHE_MARGIN, floor(view_tl.y * v.scale) - RENDER_CACHE_MARGIN) / v.scale;
+		c.tile_size = m.tile_size;
+		c.mode = getMapRenderMode();
+		c.draw_grid = draw_grid;
+		c.show_hidden = show_hidden;
+
+		renderCacheRows(m, c, draw_grid, show_hidden, 0, h);
+		c.stamp = m.edit_stamp + 1; // Never 0, so an unedited map still counts as rendered
+	}
+	else if (c.stamp <= m.edit_stamp)
+	{
+		// Redraw the band of rows edited since the last sync, a pixel of slack for the grid lines
+		int y0 = m.height, y1 = -1;
+		for (int y = 0; y < static_cast<int>(m.row_stamps.size()); ++y)
 		{
-			View::drawLine(v, vec2d(x * m.tile_size, vis_tl.y * m.tile_size), vec2d(x * m.tile_size, vis_br.y * m.tile_size + m.tile_size), al_map_rgb(40, 40, 40), 1);
+			if (m.row_stamps[y] < c.stamp) continue;
+			y0 = std::min(y0, y);
+			y1 = std::max(y1, y);
 		}
 
-		for (int y = vis_tl.y; y <= vis_br.y + 1; ++y)
+		if (y1 >= y0)
 		{
-			View::drawLine(v, vec2d(vis_tl.x * m.tile_size, y * m.tile_size), vec2d(vis_br.x * m.tile_size + m.tile_size, y * m.tile_size), al_map_rgb(40, 40, 40), 1);
+			int p0 = static_cast<int>(floor((y0 * m.tile_size - c.world_tl.y) * c.scale)) - 1;
+			int p1 = static_cast<int>(ceil(((y1 + 1) * m.tile_size - c.world_tl.y) * c.scale)) + 1;
+			p0 = std::max(p0, 0);
+			p1 = std::min(p1, h);
+
+			if (p0 < p1) renderCacheRows(m, c, draw_grid, show_hidden, p0, p1);
 		}
+
+		c.stamp = m.edit_stamp + 1;
 	}
+
+	vec2d d = View::worldToScreen(c.world_tl, v);
+	al_draw_bitmap(c.target, floor(d.x + 0.5), floor(d.y + 0.5), 0);
 }
 
 void hideTile(Map &m, const vec2i& p)
@@ -232,20 +462,34 @@ void setTile(Map &m, const vec2i& p, bool show)
 {
 	if (p.x >= 0 && p.x < m.width && p.y >= 0 && p.y < m.height)
 	{
-		int index = p.y * m.width + p.x;
-
-		m.v_tiles[index] = show;
+		m.v_tiles.set(p.x, p.y, show);
+		markRowsDirty(m, p.y, p.y);
 
 		m.needs_save = true;
 	}
 }
+void setTileRect(Map& m, const vec2i& tl, const vec2i& br, bool show)
+{
+	m.v_tiles.setRect(tl, br, show);
+	markRowsDirty(m, std::min(tl.y, br.y), std::max(tl.y, br.y));
+	m.needs_save = true;
+}
+void setTiles(Map& m, const vec2i& tl, const TileBitset& tiles)
+{
+	m.v_tiles.pasteRect(tl, tiles);
+	markRowsDirty(m, tl.y, tl.y + tiles.height() - 1);
+	m.needs_save = true;
+}
+void replaceTiles(Map& m, const TileBitset& tiles)
+{
+	m.v_tiles = tiles;
+	markRowsDirty(m, 0, m.height - 1);
+}
 bool isTileShown(const Map& m, const vec2i& p)
 {
 	if (p.x >= 0 && p.x < m.width && p.y >= 0 && p.y < m.height)
 	{
-		int index = p.y * m.width + p.x;
-
-		return m.v_tiles[index];
+		return m.v_tiles.test(p.x, p.y);
 	}
 
 	return false;
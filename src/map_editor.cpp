@@ -1,14 +1,19 @@
 #include <iostream>
 #include <math.h>
 #include <functional>
+#include <algorithm> // std::find
 #include <allegro5/allegro_color.h>
 
 #include "map_editor.hpp"
 #include "util.hpp"
 #include "editor_events.hpp"
+#include "bundle.hpp"
+#include "thread_pool.hpp"
+
+#include <filesystem>
+#include <chrono>
 
 constexpr int BOTTOM_BAR_HEIGHT = 64;
-constexpr size_t UNDO_STACK_LIMIT = 50;
 constexpr double MIN_ZOOM = 0.13;
 constexpr double MAX_ZOOM = 2.19;
 constexpr double ZOOM_FACTOR = 0.08;
@@ -20,7 +25,8 @@ void MapEditor::resizeView(vec2i view_pos, vec2i view_size)
 }
 
 MapEditor::MapEditor(InputHandler &input, vec2i view_pos, vec2i view_size)
-	: m_input(input), image_loaded(false), dragging(false), filling(false), show_hidden(false), draw_grid(true)
+	: m_input(input), image_loaded(false), dragging(false), filling(false), show_hidden(false), draw_grid(true),
+	  snapshots(std::make_shared<TileSnapshotChannel>()), live_sync(std::make_shared<LiveSync>(snapshots))
 {
 	al_init_user_event_source(&m_event_source);
 
@@ -29,37 +35,115 @@ MapEditor::MapEditor(InputHandler &input, vec2i view_pos, vec2i view_size)
 	resizeView(view_pos, view_size);
 
 	last_tile_hovered = {-1, -1};
+
+	m_input.loadBindings(EDITOR_BINDINGS, "editor bindings");
 }
 
 bool MapEditor::create(std::string image_path, int tile_size)
 {
-	// TODO: Very minor differences with MapEditor::load(), combine?
 	// TODO: Ask user to save previous map if one was open
-	Map temp;
-	if (!createMap(temp, image_path, tile_size))
+	PendingMap next;
+	next.tile_size = tile_size;
+	startImport(image_path, std::move(next));
+
+	return true;
+}
+
+void MapEditor::startImport(const std::string& image_path, PendingMap&& next)
+{
+	// Replacing the import cancels one that is still running, along with its partial upload
+	import = std::make_unique<ImageImport>(image_path, getMapImagePageSize());
+	pending = std::move(next);
+}
+
+void MapEditor::updateImport()
+{
+	if (!import) return;
+
+	// Decoding happened on the worker pool, only the texture upload runs here, a slice per tick
+	if (import->isReadyForUpload()) import->upload();
+
+	MapImage image;
+	if (import->takeImage(image))
 	{
-		std::cerr << "Failed to create map from image file: " << image_path << std::endl;
-		return false;
+		Map temp;
+		bool created = pending.loaded ? createMap(temp, image, pending.file, pending.info, pending.tiles, view)
+			: createMap(temp, image, import->getPath(), pending.tile_size);
+
+		if (created)
+		{
+			ImportStats stats = import->getStats();
+			std::cout << "Imported " << import->getPath() << ": " << stats.source_bytes / (1024.0 * 1024.0) << " MB, "
+				<< (stats.cache_hit ? "cached" : "decoded") << " in " << stats.cpuTime() << "s (" << stats.throughput() << " MB/s), upload "
+				<< stats.upload_time << "s" << std::endl;
+
+			if (pending.loaded) finishLoad(temp);
+			else
+			{
+				// We have successfully loaded a map
+				// Unsaved edits to the old map are dropped with it
+				discardJournal();
+				destroyMap(map);
+				map = temp;
+				bundle_map_name.clear();
+				clearHistory();
+
+				if (!image_loaded)
+				{
+					enableKeybinds();
+					image_loaded = true;
+				}
+			}
+		}
+		else
+		{
+			std::cerr << "Map doesn't match its image: " << import->getPath() << std::endl;
+			destroyMapImage(image);
+		}
 	}
 
-	// We have successfully loaded a map
-	destroyMap(map);
-	map = temp;
-	undo_stack.clear();
-	redo_stack.clear();
-
-	if (!image_loaded)
+	if (import->isFinished())
 	{
-		enableKeybinds();
-		image_loaded = true;
+		if (import->getStage() == IMPORT_FAILED) std::cerr << "Failed to create map from image file: " << import->getPath() << std::endl;
+		import.reset();
+		pending = PendingMap();
 	}
+}
 
-	return true;
+bool MapEditor::isImporting() const
+{
+	return import != nullptr;
+}
+
+float MapEditor::getImportProgress() const
+{
+	return import ? import->getProgress() : 0.0f;
+}
+
+std::string MapEditor::getImportStage() const
+{
+	return import ? import->getStageName() : "";
+}
+
+void MapEditor::cancelImport()
+{
+	if (import) import->cancel();
+}
+
+bool MapEditor::isAnimating()
+{
+	if (import) return true;
+	if (!image_loaded || m_input.isMouseDown(MOUSE::MIDDLE)) return false;
+
+	return m_input.isKeyDown(ALLEGRO_KEY_A) || m_input.isKeyDown(ALLEGRO_KEY_D) || m_input.isKeyDown(ALLEGRO_KEY_W)
+		|| (m_input.isKeyDown(ALLEGRO_KEY_S) && !m_input.isModifierDown(ALLEGRO_KEYMOD_CTRL));
 }
 
 MapEditor::~MapEditor()
 {
-	al_destroy_bitmap(map.bmp);
+	// A clean exit leaves nothing to recover, what wasn't saved was given up
+	discardJournal();
+	destroyMap(map);
 }
 
 void MapEditor::handleEvents(const ALLEGRO_EVENT &ev)
@@ -96,6 +180,9 @@ void MapEditor::handleEvents(const ALLEGRO_EVENT &ev)
 
 void MapEditor::update(double delta_time)
 {
+	updateImport();
+	updateJournal();
+
 	if (!image_loaded)
 		return;
 
@@ -121,12 +208,29 @@ void MapEditor::update(double delta_time)
 
 void MapEditor::draw()
 {
-	if (!image_loaded)
+	// An import with its coarsest level up stands in for the map until the rest is uploaded
+	const MapImage* placeholder = import ? import->getPlaceholder() : nullptr;
+
+	if (!image_loaded && !placeholder)
 		return;
 
 	// View Drawing, clipped
 	al_set_clipping_rectangle((int)view.screen_pos.x, (int)view.screen_pos.y, (int)view.size.x, (int)view.size.y);
 
+	if (placeholder)
+	{
+		View::ViewPort v = view;
+		if (pending.loaded)
+		{
+			v.world_pos = pending.info.view_pos;
+			v.scale = pending.info.view_scale;
+		}
+
+		drawMapImagePreview(*placeholder, v);
+		al_reset_clipping_rectangle();
+		return;
+	}
+
 	drawMap(map, view, draw_grid, show_hidden);
 
 	if (filling)
@@ -150,12 +254,223 @@ void MapEditor::draw()
 void MapEditor::pushCommand(std::unique_ptr<Command> c)
 {
 	undo_stack.push_back(std::move(c));
+	journalCommand(*undo_stack.back(), false);
+	syncCommand(*undo_stack.back(), false);
 
+	for (const auto& r : redo_stack) undo_bytes -= r->getSize();
 	redo_stack.clear();
 
-	// Limit undo stack size
-	if (undo_stack.size() > UNDO_STACK_LIMIT)
+	undo_bytes += undo_stack.back()->getSize();
+	history.commit(map);
+	trimHistory();
+}
+
+void MapEditor::clearHistory()
+{
+	undo_stack.clear();
+	redo_stack.clear();
+	undo_bytes = 0;
+	history.reset(map);
+}
+
+// Oldest first, the redo stack goes with the next push anyway
+void MapEditor::trimHistory()
+{
+	while (getUndoMemory() > undo_budget && undo_stack.size() > 1)
+	{
+		undo_bytes -= undo_stack.front()->getSize();
 		undo_stack.pop_front();
+		history.dropOldest();
+	}
+}
+
+void MapEditor::setUndoBudget(size_t bytes)
+{
+	undo_budget = bytes;
+	trimHistory();
+}
+
+void MapEditor::jumpToHistory(size_t index)
+{
+	if (isImporting() || index >= history.size() || index == history.getCursor()) return;
+
+	std::shared_ptr<const TileSnapshot> from = history.current();
+	std::shared_ptr<const TileSnapshot> to = history.at(index);
+	if (!applyTileSnapshot(map, *to, from.get())) return;
+
+	// The commands in between only change stacks, nothing is replayed
+	while (undo_stack.size() > index)
+	{
+		redo_stack.push_back(std::move(undo_stack.back()));
+		undo_stack.pop_back();
+	}
+	while (undo_stack.size() < index)
+	{
+		undo_stack.push_back(std::move(redo_stack.back()));
+		redo_stack.pop_back();
+	}
+	history.setCursor(index);
+
+	// The journal gets the bands that differ, the viewer a snapshot
+	for (size_t b = 0; b < to->blocks.size(); ++b)
+	{
+		if (to->blocks[b] != from->blocks[b]) journal.logPaste(map, {0, static_cast<int>(b) * TILE_SNAPSHOT_BLOCK_ROWS}, *to->blocks[b]);
+	}
+
+	if (live_sync_enabled) fireEvent(AXE_EDITOR_EVENT_COPY_DATA);
+}
+
+void MapEditor::journalCommand(const Command& c, bool undone)
+{
+	c.journal(journal, undone);
+}
+
+void MapEditor::syncCommand(const Command& c, bool undone)
+{
+	if (!live_sync_enabled) return;
+
+	c.sync(*live_sync, undone);
+	fireEvent(AXE_EDITOR_EVENT_LIVE_SYNC);
+}
+
+void MapEditor::setLiveSync(bool enabled)
+{
+	if (enabled && !live_sync_enabled) fireEvent(AXE_EDITOR_EVENT_COPY_DATA);
+	live_sync_enabled = enabled;
+}
+
+// Called once the map matches map.saved_file, after a save or a load. A file with a JRNL section
+// is the base, anything else gets a copy of the map written beside the journal.
+void MapEditor::startJournal()
+{
+	discardJournal();
+	if (map.saved_file.empty()) return;
+
+	journal_files.map_file = map.saved_file;
+	if (map.journal_id != 0)
+	{
+		journal_files.base = map.saved_file;
+		openJournal();
+	}
+	else
+	{
+		map.journal_id = makeJournalId();
+		rebaseJournal();
+	}
+}
+
+// Starts a journal after the current edit. Once there is a base it joins the chain recovery
+// replays, until then a crash loses what it holds.
+bool MapEditor::openJournal()
+{
+	const std::string old_file = journal.getPath();
+	const std::string file = makeJournalPath(journal_files.map_file, map.journal_seq);
+
+	if (!journal.open(file, map.journal_id, map.journal_seq))
+	{
+		// Left closed, the next save or load tries again
+		return false;
+	}
+
+	// One that never got a base isn't replayed by anything
+	std::error_code ec;
+	auto& chain = journal_files.journals;
+	if (!old_file.empty() && old_file != file && std::find(chain.begin(), chain.end(), old_file) == chain.end())
+	{
+		std::filesystem::remove(old_file, ec);
+	}
+
+	if (journal_files.base.empty()) return true;
+
+	if (chain.empty() || chain.back() != file) chain.push_back(file);
+	writeJournalPointer(JOURNAL_POINTER_PATH, journal_files);
+
+	return true;
+}
+
+// Moves on to a new journal and writes its base from the history's current step on the worker
+// pool. The chain keeps the old base and journals until it is on disk.
+void MapEditor::rebaseJournal()
+{
+	std::shared_ptr<const TileSnapshot> tiles = history.current();
+	if (!tiles || !openJournal()) return;
+
+	MapFileInfo info;
+	info.image_path = map.path;
+	info.width = map.width;
+	info.height = map.height;
+	info.tile_size = map.tile_size;
+	info.view_pos = view.world_pos;
+	info.view_scale = view.scale;
+	info.journal_id = map.journal_id;
+	info.journal_seq = map.journal_seq;
+
+	const std::string base = journal.getPath() + JOURNAL_BASE_EXT;
+	auto task = std::make_shared<std::packaged_task<bool()>>([base, info, tiles]()
+	{
+		return writeMapFile(base, info, flattenTileSnapshot(*tiles));
+	});
+	journal_base_write = task->get_future();
+	getWorkerPool().submit([task]() { (*task)(); });
+}
+
+// Polled every tick, the history only matches map.journal_seq between edits
+void MapEditor::updateJournal()
+{
+	if (journal_base_write.valid() && journal_base_write.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		if (journal_base_write.get())
+		{
+			// Only the open journal is needed from here, what it replaced goes
+			JournalPointer old = journal_files;
+			journal_files.base = journal.getPath() + JOURNAL_BASE_EXT;
+			journal_files.journals = {journal.getPath()};
+
+			if (writeJournalPointer(JOURNAL_POINTER_PATH, journal_files))
+			{
+				std::error_code ec;
+				for (const std::string& j : old.journals)
+				{
+					if (j != journal.getPath()) std::filesystem::remove(j, ec);
+				}
+				if (old.base != old.map_file) std::filesystem::remove(old.base, ec);
+			}
+			journal_compact_size = JOURNAL_COMPACT_SIZE;
+		}
+		else
+		{
+			// Tried again once the journal has grown as much again, not on every edit
+			std::cerr << "Failed to write edit journal base: " << journal.getPath() << JOURNAL_BASE_EXT << std::endl;
+			journal_compact_size = journal.getSize() + JOURNAL_COMPACT_SIZE;
+		}
+	}
+
+	if (journal.isOpen() && !journal_base_write.valid() && journal.getSize() > journal_compact_size) rebaseJournal();
+}
+
+void MapEditor::discardJournal()
+{
+	// Waited for, so the base can't land after the rest is deleted
+	if (journal_base_write.valid()) journal_base_write.wait();
+	journal_base_write = std::future<bool>();
+
+	const std::string open_file = journal.getPath();
+	journal.close();
+
+	// The pointer goes first, so a crash never finds half a chain
+	std::error_code ec;
+	if (!journal_files.base.empty()) std::filesystem::remove(JOURNAL_POINTER_PATH, ec);
+
+	for (const std::string& j : journal_files.journals) std::filesystem::remove(j, ec);
+	if (journal_files.base != journal_files.map_file) std::filesystem::remove(journal_files.base, ec);
+	if (!open_file.empty())
+	{
+		std::filesystem::remove(open_file, ec);
+		std::filesystem::remove(open_file + JOURNAL_BASE_EXT, ec);
+	}
+
+	journal_files = JournalPointer();
+	journal_compact_size = JOURNAL_COMPACT_SIZE;
 }
 
 void MapEditor::onMouseWheelUp()
@@ -174,13 +489,6 @@ void MapEditor::onMiddleMouseUp()
 }
 void MapEditor::onMiddleMouseDown()
 {
-	if (m_input.isModifierDown(ALLEGRO_KEYMOD_CTRL))
-	{
-		fireEvent(AXE_EDITOR_EVENT_MOVE_VIEW);
-		fireEvent(AXE_EDITOR_EVENT_COPY_DATA);
-		return;
-	}
-
 	if (isMouseInView())
 	{
 		dragging_start_pos = m_input.getMousePos();
@@ -192,11 +500,11 @@ void MapEditor::onLeftMouseUp()
 {
 	if (m_input.isModifierDown(ALLEGRO_KEYMOD_SHIFT) && filling)
 	{
-		pushCommand(std::make_unique<FillTileCommand>(map, true, fill_start_pos, getTilePos(map, view, m_input.getMousePos())));
+		pushCommand(std::make_unique<FillTileCommand>(map, true, fill_start_pos, getTilePos(map, view, m_input.getMousePos()), &undo_pool));
 	}
 	else if (!tiles_to_edit.empty())
 	{
-		pushCommand(std::make_unique<SetTileCommand>(map, tiles_to_edit, true));
+		pushCommand(std::make_unique<SetTileCommand>(map, tiles_to_edit, true, &undo_pool));
 		tiles_to_edit.clear();
 	}
 
@@ -222,11 +530,11 @@ void MapEditor::onRightMouseUp()
 {
 	if (m_input.isModifierDown(ALLEGRO_KEYMOD_SHIFT) && filling)
 	{
-		pushCommand(std::make_unique<FillTileCommand>(map, false, fill_start_pos, getTilePos(map, view, m_input.getMousePos())));
+		pushCommand(std::make_unique<FillTileCommand>(map, false, fill_start_pos, getTilePos(map, view, m_input.getMousePos()), &undo_pool));
 	}
 	else if (!tiles_to_edit.empty())
 	{
-		pushCommand(std::make_unique<SetTileCommand>(map, tiles_to_edit, false));
+		pushCommand(std::make_unique<SetTileCommand>(map, tiles_to_edit, false, &undo_pool));
 		tiles_to_edit.clear();
 	}
 
@@ -256,22 +564,163 @@ void MapEditor::addTileToEditVector(vec2i position, bool show)
 
 bool MapEditor::save()
 {
-	return saveMap(map, "map-save.mdf", view);
+	// The JRNL section makes the saved file the next journal's base
+	if (map.journal_id == 0) map.journal_id = makeJournalId();
+	if (!saveMap(map, MAP_SAVE_PATH, view)) return false;
+
+	// Everything journaled so far is in the file now
+	startJournal();
+	return true;
+}
+
+void MapEditor::autosave()
+{
+	// A map being imported isn't swapped in yet, so the snapshot would be of the old one
+	if (!image_loaded || isImporting()) return;
+
+	autosaver.save(map, history.current(), view);
+}
+
+bool MapEditor::saveToBundle(bool embed_decoded)
+{
+	// A map opened from the bundle keeps its name, a new one is named after its image
+	std::string name = bundle_map_name.empty() ? std::filesystem::path(map.path).stem().string() : bundle_map_name;
+
+	if (!image_loaded || !saveMapToBundle(map, CAMPAIGN_BUNDLE_PATH, name, view, embed_decoded))
+	{
+		std::cerr << "Failed to save map to campaign bundle: " << CAMPAIGN_BUNDLE_PATH << std::endl;
+		return false;
+	}
+
+	bundle_map_name = name;
+	return true;
+}
+
+bool MapEditor::loadFromBundle(const std::string& name)
+{
+	Bundle b;
+	PendingMap next;
+
+	if (!openBundle(b, CAMPAIGN_BUNDLE_PATH) || !readBundleMap(b, name, next.info, next.tiles))
+	{
+		std::cerr << "Failed to load map " << name << " from campaign bundle: " << CAMPAIGN_BUNDLE_PATH << std::endl;
+		return false;
+	}
+
+	// The image is read through its bundle path by the import, the table of contents isn't needed anymore
+	closeBundle(b);
+
+	next.loaded = true;
+	next.bundle_name = name;
+	startImport(next.info.image_path, std::move(next));
+
+	return true;
+}
+
+std::vector<std::string> MapEditor::getBundleMaps() const
+{
+	Bundle b;
+	std::vector<std::string> names;
+
+	std::error_code ec;
+	if (!std::filesystem::exists(CAMPAIGN_BUNDLE_PATH, ec) || !openBundle(b, CAMPAIGN_BUNDLE_PATH)) return names;
+
+	for (const BundleMap& m : b.maps) names.push_back(m.name);
+
+	return names;
 }
+
 bool MapEditor::load(std::string path)
 {
-	Map temp;
-	if (!loadMap(temp, path, view))
+	// The tiles are small next to the image, which is imported like a new map's
+	PendingMap next;
+	if (!readMapFile(path, next.info, next.tiles))
 	{
 		std::cerr << "Failed to load map: " << path << std::endl;
 		return false;
 	}
 
+	next.loaded = true;
+	next.file = path;
+	startImport(next.info.image_path, std::move(next));
+
+	return true;
+}
+
+void MapEditor::finishLoad(Map& temp)
+{
+	// Edits made before a crash are replayed onto the chain's base
+	const JournalPointer recovered = pending.recover;
+	int replayed = 0;
+	for (const std::string& j : recovered.journals) replayed += replayJournal(j, temp);
+
+	swapInLoadedMap(temp);
+	bundle_map_name = pending.bundle_name;
+
+	if (recovered.map_file.empty())
+	{
+		startJournal();
+		return;
+	}
+
+	std::cout << "Recovered " << replayed << " edits to " << recovered.map_file << std::endl;
+
+	// Not saved until the user saves. The file doesn't hold the base's blocks, so that save rewrites it.
+	map.saved_file = recovered.map_file;
+	map.saved_file_size = 0;
+	map.needs_save = true;
+
+	// The chain stays live, a crash from here replays it again with what was added since.
+	// A clean exit drops it like any unsaved edit.
+	journal_files = recovered;
+	openJournal();
+}
+
+bool MapEditor::recover()
+{
+	JournalPointer chain;
+	if (!readJournalPointer(JOURNAL_POINTER_PATH, chain)) return false;
+
+	// Edits past the header in any journal, otherwise there is nothing to recover
+	std::error_code ec;
+	bool has_edits = false;
+	for (const std::string& j : chain.journals)
+	{
+		uint64_t journal_size = std::filesystem::file_size(j, ec);
+		has_edits = has_edits || (!ec && journal_size > JOURNAL_HEADER_SIZE);
+	}
+
+	if (!has_edits)
+	{
+		// Dropped like discardJournal() would have on a clean exit
+		std::filesystem::remove(JOURNAL_POINTER_PATH, ec);
+		for (const std::string& j : chain.journals) std::filesystem::remove(j, ec);
+		if (chain.base != chain.map_file) std::filesystem::remove(chain.base, ec);
+		return false;
+	}
+
+	PendingMap next;
+	if (!readMapFile(chain.base, next.info, next.tiles))
+	{
+		std::cerr << "Failed to read journal base: " << chain.base << std::endl;
+		return false;
+	}
+
+	next.loaded = true;
+	next.recover = chain;
+	startImport(next.info.image_path, std::move(next));
+
+	return true;
+}
+
+void MapEditor::swapInLoadedMap(Map& temp)
+{
+	// Unsaved edits to the old map are dropped with it
+	discardJournal();
 	destroyMap(map);
 	map = temp;
 
-	undo_stack.clear();
-	redo_stack.clear();
+	clearHistory();
 
 	if (!image_loaded)
 	{
@@ -281,17 +730,19 @@ bool MapEditor::load(std::string path)
 
 	fireEvent(AXE_EDITOR_EVENT_COPY_DATA);
 	// TODO: save viewer postion and set it here
-	return true;
 }
 
 void MapEditor::undo()
 {
-	if (!undo_stack.empty() && m_input.isModifierDown(ALLEGRO_KEYMOD_CTRL))
+	if (!undo_stack.empty())
 	{
 		Command *c = undo_stack.back().release();
 		undo_stack.pop_back();
 
 		c->undo();
+		journalCommand(*c, true);
+		syncCommand(*c, true);
+		history.setCursor(undo_stack.size());
 
 		redo_stack.push_back(std::unique_ptr<Command>(c));
 	}
@@ -299,14 +750,17 @@ void MapEditor::undo()
 
 void MapEditor::redo()
 {
-	if (!redo_stack.empty() && m_input.isModifierDown(ALLEGRO_KEYMOD_CTRL))
+	if (!redo_stack.empty())
 	{
 		Command *c = redo_stack.back().release();
 		redo_stack.pop_back();
 
 		c->redo();
+		journalCommand(*c, false);
+		syncCommand(*c, false);
 
 		undo_stack.push_back(std::unique_ptr<Command>(c));
+		history.setCursor(undo_stack.size());
 	}
 }
 
@@ -338,7 +792,12 @@ void MapEditor::fireEvent(int event_id)
 	switch (event_id)
 	{
 	case AXE_EDITOR_EVENT_COPY_DATA:
-		editor_event.user.data1 = reinterpret_cast<intptr_t>(&map);
+		snapshots->publish(map, live_sync->getSequence());
+		editor_event.user.data1 = static_cast<intptr_t>(snapshots->latest()->version);
+		break;
+
+	case AXE_EDITOR_EVENT_LIVE_SYNC:
+		editor_event.user.data1 = static_cast<intptr_t>(live_sync->getSequence());
 		break;
 
 	case AXE_EDITOR_EVENT_MOVE_VIEW:
@@ -350,7 +809,8 @@ void MapEditor::fireEvent(int event_id)
 	case AXE_EDITOR_EVENT_ZOOM_OUT:
 		break;
 
-	case AXE_EDITOR_EVENT_SHOWHIDE_GRID:
+	case AXE_EDITOR_EVENT_SHOWHIDE_GRID: // Fall through
+	case AXE_EDITOR_EVENT_WAKE_VIEWER:
 		break;
 
 	default:
@@ -369,68 +829,59 @@ ALLEGRO_EVENT_SOURCE *MapEditor::getEventSource()
 
 void MapEditor::enableKeybinds()
 {
-	m_input.setKeybind(MOUSE::WHEELUP, [this]()
-					   { onMouseWheelUp(); });
-	m_input.setKeybind(MOUSE::WHEELDOWN, [this]()
-					   { onMouseWheelDown(); });
-	m_input.setKeybind(MOUSE::MIDDLE, [this]()
-					   { onMiddleMouseDown(); });
-	m_input.setKeybind(
-		MOUSE::MIDDLE, [this]()
-		{ onMiddleMouseUp(); },
-		false);
-	m_input.setKeybind(MOUSE::LEFT, [this]()
-					   { onLeftMouseDown(); });
-	m_input.setKeybind(
-		MOUSE::LEFT, [this]()
-		{ onLeftMouseUp(); },
-		false);
-	m_input.setKeybind(MOUSE::RIGHT, [this]()
-					   { onRightMouseDown(); });
-	m_input.setKeybind(
-		MOUSE::RIGHT, [this]()
-		{ onRightMouseUp(); },
-		false);
-	m_input.setKeybind(ALLEGRO_KEY_G, [this]()
-					   { if (m_input.isModifierDown(ALLEGRO_KEYMOD_CTRL)) { fireEvent(AXE_EDITOR_EVENT_SHOWHIDE_GRID); return; } draw_grid = !draw_grid; });
-	m_input.setKeybind(ALLEGRO_KEY_Z, [this]()
-					   { undo(); });
-	m_input.setKeybind(ALLEGRO_KEY_Y, [this]()
-					   { redo(); });
-	m_input.setKeybind(ALLEGRO_KEY_S, [this]()
-					   { if (m_input.isModifierDown(ALLEGRO_KEYMOD_CTRL)) save(); });
-	m_input.setKeybind(ALLEGRO_KEY_L, [this]()
-					   { if (m_input.isModifierDown(ALLEGRO_KEYMOD_CTRL)) load("test.file"); }); // TODO: Need save to correct file and to expand fucntionality, save-as etc.
-	m_input.setKeybind(ALLEGRO_KEY_C, [this]()
-					   { if (m_input.isModifierDown(ALLEGRO_KEYMOD_CTRL)) view.world_pos = { 0, 0 }; });
-	m_input.setKeybind(ALLEGRO_KEY_R, [this]()
-					   { view.scale = 1.0; });
-	m_input.setKeybind(ALLEGRO_KEY_SPACE, [this]()
-					   { show_hidden = !show_hidden; });
-	m_input.setKeybind(ALLEGRO_KEY_UP, [this]()
-					   { fireEvent(AXE_EDITOR_EVENT_ZOOM_IN); });
-	m_input.setKeybind(ALLEGRO_KEY_DOWN, [this]()
-					   { fireEvent(AXE_EDITOR_EVENT_ZOOM_OUT); });
-	m_input.setKeybind(ALLEGRO_KEY_U, [this]()
-					   { fireEvent(AXE_EDITOR_EVENT_COPY_DATA); });
+	m_input.setAction("zoom_in", [this]()
+					  { onMouseWheelUp(); });
+	m_input.setAction("zoom_out", [this]()
+					  { onMouseWheelDown(); });
+	m_input.setAction(
+		"pan", [this]()
+		{ onMiddleMouseDown(); },
+		[this]()
+		{ onMiddleMouseUp(); });
+	m_input.setAction("move_viewer", [this]()
+					  { fireEvent(AXE_EDITOR_EVENT_MOVE_VIEW); fireEvent(AXE_EDITOR_EVENT_COPY_DATA); });
+	m_input.setAction(
+		"reveal", [this]()
+		{ onLeftMouseDown(); },
+		[this]()
+		{ onLeftMouseUp(); });
+	m_input.setAction(
+		"hide", [this]()
+		{ onRightMouseDown(); },
+		[this]()
+		{ onRightMouseUp(); });
+	m_input.setAction("toggle_grid", [this]()
+					  { draw_grid = !draw_grid; });
+	m_input.setAction("toggle_viewer_grid", [this]()
+					  { fireEvent(AXE_EDITOR_EVENT_SHOWHIDE_GRID); });
+	m_input.setAction("undo", [this]()
+					  { undo(); });
+	m_input.setAction("redo", [this]()
+					  { redo(); });
+	m_input.setAction("save", [this]()
+					  { save(); });
+	m_input.setAction("load", [this]()
+					  { load("test.file"); }); // TODO: Need save to correct file and to expand fucntionality, save-as etc.
+	m_input.setAction("center_view", [this]()
+					  { view.world_pos = { 0, 0 }; });
+	m_input.setAction("reset_zoom", [this]()
+					  { view.scale = 1.0; });
+	m_input.setAction("toggle_hidden", [this]()
+					  { show_hidden = !show_hidden; });
+	m_input.setAction("viewer_zoom_in", [this]()
+					  { fireEvent(AXE_EDITOR_EVENT_ZOOM_IN); });
+	m_input.setAction("viewer_zoom_out", [this]()
+					  { fireEvent(AXE_EDITOR_EVENT_ZOOM_OUT); });
+	m_input.setAction("send_to_viewer", [this]()
+					  { fireEvent(AXE_EDITOR_EVENT_COPY_DATA); });
 }
 
 void MapEditor::disableKeybinds()
 {
-	m_input.clearKeybind(MOUSE::WHEELUP);
-	m_input.clearKeybind(MOUSE::WHEELDOWN);
-	m_input.clearKeybind(MOUSE::MIDDLE);
-	m_input.clearKeybind(MOUSE::LEFT);
-	m_input.clearKeybind(MOUSE::RIGHT);
-	m_input.clearKeybind(ALLEGRO_KEY_G);
-	m_input.clearKeybind(ALLEGRO_KEY_Z);
-	m_input.clearKeybind(ALLEGRO_KEY_Y);
-	m_input.clearKeybind(ALLEGRO_KEY_S);
-	m_input.clearKeybind(ALLEGRO_KEY_L);
-	m_input.clearKeybind(ALLEGRO_KEY_C);
-	m_input.clearKeybind(ALLEGRO_KEY_R);
-	m_input.clearKeybind(ALLEGRO_KEY_SPACE);
-	m_input.clearKeybind(ALLEGRO_KEY_UP);
-	m_input.clearKeybind(ALLEGRO_KEY_DOWN);
-	m_input.clearKeybind(ALLEGRO_KEY_U);
+	for (const char* action : { "zoom_in", "zoom_out", "pan", "move_viewer", "reveal", "hide", "toggle_grid", "toggle_viewer_grid",
+								"undo", "redo", "save", "load", "center_view", "reset_zoom", "toggle_hidden",
+								"viewer_zoom_in", "viewer_zoom_out", "send_to_viewer" })
+	{
+		m_input.clearAction(action);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,465 @@
+#include "map_image.hpp"
+#include "image_cache.hpp"
+#include "bundle.hpp"
+#include "texture_budget.hpp"
+
+#include <iostream>
+#include <algorithm> // std::min, std::max, std::sort
+#include <cstring> // memcpy
+#include <math.h> // floor, log2
+
+// Copies a rectangle of RGBA8 pixels out of (or into) a locked region, rows may have any pitch
+static void copyRows(uint8_t* dst, int dst_pitch, const uint8_t* src, int src_pitch, int row_bytes, int rows)
+{
+	for (int y = 0; y < rows; ++y)
+	{
+		memcpy(dst + static_cast<ptrdiff_t>(y) * dst_pitch, src + static_cast<ptrdiff_t>(y) * src_pitch, row_bytes);
+	}
+}
+
+static bool decodeBitmap(DecodedImage& img, ALLEGRO_BITMAP* bmp, const std::string& name)
+{
+	img.levels.clear();
+	img.mapping.reset();
+
+	if (!bmp)
+	{
+		std::cerr << "Failed to decode image: " << name << std::endl;
+		return false;
+	}
+
+	ImageLevel level;
+	level.width = al_get_bitmap_width(bmp);
+	level.height = al_get_bitmap_height(bmp);
+	level.pixels.resize(level.bytes());
+
+	ALLEGRO_LOCKED_REGION* lr = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+
+	if (!lr)
+	{
+		std::cerr << "Failed to lock decoded image: " << name << std::endl;
+		al_destroy_bitmap(bmp);
+		return false;
+	}
+
+	copyRows(level.pixels.data(), level.width * 4, static_cast<const uint8_t*>(lr->data), lr->pitch, level.width * 4, level.height);
+
+	al_unlock_bitmap(bmp);
+	al_destroy_bitmap(bmp);
+
+	img.levels.push_back(std::move(level));
+
+	return true;
+}
+
+bool decodeImage(DecodedImage& img, const std::string& path)
+{
+	// Memory bitmaps are not limited by the max texture size
+	return decodeBitmap(img, al_load_bitmap_flags(path.c_str(), ALLEGRO_MEMORY_BITMAP), path);
+}
+
+bool decodeImage(DecodedImage& img, ALLEGRO_FILE* file, const std::string& ident)
+{
+	return decodeBitmap(img, al_load_bitmap_flags_f(file, ident.c_str(), ALLEGRO_MEMORY_BITMAP), ident);
+}
+
+ImageLevel createHalfLevel(const ImageLevel& src)
+{
+	ImageLevel dst;
+	dst.width = std::max(1, (src.width + 1) / 2);
+	dst.height = std::max(1, (src.height + 1) / 2);
+	dst.pixels.resize(dst.bytes());
+
+	return dst;
+}
+
+// 2x2 box filter, odd edges reuse the last row/column
+void downsampleRows(const ImageLevel& src, ImageLevel& dst, int y0, int y1)
+{
+	const size_t src_pitch = static_cast<size_t>(src.width) * 4;
+
+	for (int y = y0; y < y1 && y < dst.height; ++y)
+	{
+		const uint8_t* r0 = src.data() + std::min(y * 2, src.height - 1) * src_pitch;
+		const uint8_t* r1 = src.data() + std::min(y * 2 + 1, src.height - 1) * src_pitch;
+		uint8_t* out = dst.pixels.data() + static_cast<size_t>(y) * dst.width * 4;
+
+		for (int x = 0; x < dst.width; ++x)
+		{
+			int x0 = std::min(x * 2, src.width - 1) * 4;
+			int x1 = std::min(x * 2 + 1, src.width - 1) * 4;
+
+			for (int c = 0; c < 4; ++c)
+			{
+				out[x * 4 + c] = static_cast<uint8_t>((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) / 4);
+			}
+		}
+	}
+}
+
+void buildImageLevels(DecodedImage& img)
+{
+	if (img.levels.empty()) return;
+
+	img.levels.resize(1);
+
+	while (static_cast<int>(img.levels.size()) < MAP_IMAGE_MAX_LEVELS)
+	{
+		const ImageLevel& last = img.levels.back();
+		if (last.width <= 1 && last.height <= 1) break;
+
+		ImageLevel next = createHalfLevel(last);
+		downsampleRows(last, next, 0, next.height);
+		img.levels.push_back(std::move(next));
+	}
+}
+
+ImagePage sliceImagePage(const DecodedImage& img, int level, int col, int row, int page_size)
+{
+	const ImageLevel& src = img.levels[level];
+
+	ImagePage page;
+	page.level = level;
+	page.col = col;
+	page.row = row;
+	page.width = std::min(page_size, src.width - col * page_size);
+	page.height = std::min(page_size, src.height - row * page_size);
+	page.pixels.resize(static_cast<size_t>(page.width) * page.height * 4);
+
+	const uint8_t* first = src.data() + (static_cast<size_t>(row) * page_size * src.width + static_cast<size_t>(col) * page_size) * 4;
+	copyRows(page.pixels.data(), page.width * 4, first, src.width * 4, page.width * 4, page.height);
+
+	return page;
+}
+
+static ALLEGRO_BITMAP* createPage(const uint8_t* src, int src_pitch, int w, int h)
+{
+	int old_flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP | ALLEGRO_MIN_LINEAR);
+
+	ALLEGRO_BITMAP* page = al_create_bitmap(w, h);
+
+	al_set_new_bitmap_flags(old_flags);
+
+	if (!page) return nullptr;
+
+	ALLEGRO_LOCKED_REGION* lr = al_lock_bitmap(page, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+
+	if (!lr)
+	{
+		al_destroy_bitmap(page);
+		return nullptr;
+	}
+
+	copyRows(static_cast<uint8_t*>(lr->data), lr->pitch, src, src_pitch, w * 4, h);
+
+	al_unlock_bitmap(page);
+
+	return page;
+}
+
+int getMapImagePageSize()
+{
+	int page_size = MAP_IMAGE_PAGE_SIZE;
+	ALLEGRO_DISPLAY* display = al_get_current_display();
+
+	if (display)
+	{
+		int max_size = al_get_display_option(display, ALLEGRO_MAX_BITMAP_SIZE);
+		if (max_size > 0) page_size = std::min(page_size, max_size);
+	}
+
+	return page_size;
+}
+
+void layoutMapImage(MapImage& img, std::shared_ptr<const DecodedImage> decoded, int page_size)
+{
+	destroyMapImage(img);
+
+	if (!decoded || decoded->levels.empty()) return;
+
+	img.width = decoded->levels[0].width;
+	img.height = decoded->levels[0].height;
+	img.page_size = page_size;
+	img.source = decoded;
+
+	for (const ImageLevel& level : decoded->levels)
+	{
+		ImagePageLevel pl;
+		pl.width = level.width;
+		pl.height = level.height;
+		pl.cols = (level.width + page_size - 1) / page_size;
+		pl.rows = (level.height + page_size - 1) / page_size;
+		pl.pages.assign(static_cast<size_t>(pl.cols) * pl.rows, nullptr);
+		pl.last_used.assign(pl.pages.size(), 0);
+
+		img.levels.push_back(std::move(pl));
+	}
+}
+
+static uint64_t pageBytes(ALLEGRO_BITMAP* page)
+{
+	return static_cast<uint64_t>(al_get_bitmap_width(page)) * al_get_bitmap_height(page) * 4;
+}
+
+// Replaces a page slot, keeping the image and the global budget in step
+static void setPage(MapImage& img, ALLEGRO_BITMAP*& slot, ALLEGRO_BITMAP* page)
+{
+	if (slot)
+	{
+		uint64_t bytes = pageBytes(slot);
+		img.resident_bytes -= bytes;
+		removeResidentTextureBytes(bytes);
+		al_destroy_bitmap(slot);
+	}
+
+	slot = page;
+
+	if (slot)
+	{
+		uint64_t bytes = pageBytes(slot);
+		img.resident_bytes += bytes;
+		addResidentTextureBytes(bytes);
+	}
+}
+
+bool uploadImagePage(MapImage& img, const ImagePage& page)
+{
+	ImagePageLevel& pl = img.levels[page.level];
+	ALLEGRO_BITMAP*& slot = pl.pages[page.row * pl.cols + page.col];
+
+	setPage(img, slot, createPage(page.pixels.data(), page.width * 4, page.width, page.height));
+
+	return slot != nullptr;
+}
+
+bool uploadImagePage(MapImage& img, int level, int col, int row)
+{
+	if (!img.source) return false;
+
+	const ImageLevel& src = img.source->levels[level];
+	ImagePageLevel& pl = img.levels[level];
+	ALLEGRO_BITMAP*& slot = pl.pages[row * pl.cols + col];
+
+	int x = col * img.page_size;
+	int y = row * img.page_size;
+	const uint8_t* first = src.data() + (static_cast<size_t>(y) * src.width + x) * 4;
+
+	setPage(img, slot, createPage(first, src.width * 4, std::min(img.page_size, src.width - x), std::min(img.page_size, src.height - y)));
+
+	return slot != nullptr;
+}
+
+void evictImagePages(MapImage& img, uint64_t keep_stamp)
+{
+	if (!isOverTextureBudget()) return;
+
+	struct Resident { uint64_t last_used; ALLEGRO_BITMAP** slot; };
+	std::vector<Resident> resident;
+
+	for (ImagePageLevel& level : img.levels)
+	{
+		for (size_t i = 0; i < level.pages.size(); ++i)
+		{
+			if (level.pages[i] && level.last_used[i] < keep_stamp) resident.push_back(Resident{level.last_used[i], &level.pages[i]});
+		}
+	}
+
+	std::sort(resident.begin(), resident.end(), [](const Resident& a, const Resident& b) { return a.last_used < b.last_used; });
+
+	// Only this image's pages can go, they belong to this thread's display.
+	// Another image over its share gives its pages back on its own next draw.
+	for (const Resident& r : resident)
+	{
+		if (!isOverTextureBudget()) break;
+
+		setPage(img, *r.slot, nullptr);
+		countTextureEviction();
+	}
+}
+
+bool uploadMapImagePages(MapImage& img)
+{
+	const int coarsest = static_cast<int>(img.levels.size()) - 1;
+
+	// Coarsest level first, so a zoomed out view is resident even when the budget is tight.
+	// Whatever doesn't fit is uploaded when a draw first needs it.
+	for (int l = coarsest; l >= 0; --l)
+	{
+		for (int r = 0; r < img.levels[l].rows; ++r)
+		{
+			for (int c = 0; c < img.levels[l].cols; ++c)
+			{
+				if (l != coarsest && isOverTextureBudget()) return true;
+
+				if (!uploadImagePage(img, l, c, r))
+				{
+					std::cerr << "Failed to create image page " << c << ", " << r << std::endl;
+					destroyMapImage(img);
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool uploadMapImage(MapImage& img, std::shared_ptr<const DecodedImage> decoded)
+{
+	if (!decoded || decoded->levels.empty()) return false;
+
+	layoutMapImage(img, decoded, getMapImagePageSize());
+
+	return uploadMapImagePages(img);
+}
+
+bool loadDecodedImage(DecodedImage& img, const std::string& path)
+{
+	if (isBundleImagePath(path))
+	{
+		bool has_levels = false;
+		if (!loadBundleImage(img, path, has_levels)) return false;
+		if (!has_levels) buildImageLevels(img);
+		return true;
+	}
+
+	ImageCacheKey key;
+	bool cacheable = getImageCacheKey(path, key);
+
+	if (cacheable && loadCachedImage(img, key)) return true;
+
+	if (!decodeImage(img, path)) return false;
+
+	buildImageLevels(img);
+
+	if (cacheable) storeCachedImage(img, key);
+
+	return true;
+}
+
+bool loadMapImage(MapImage& img, const std::string& path)
+{
+	auto decoded = std::make_shared<DecodedImage>();
+
+	if (!loadDecodedImage(*decoded, path)) return false;
+
+	return uploadMapImage(img, decoded);
+}
+
+void destroyMapImage(MapImage& img)
+{
+	for (ImagePageLevel& level : img.levels)
+	{
+		for (ALLEGRO_BITMAP*& page : level.pages)
+		{
+			setPage(img, page, nullptr);
+		}
+	}
+
+	img.levels.clear();
+	img.source.reset();
+	img.width = 0;
+	img.height = 0;
+	img.page_size = 0;
+}
+
+bool isMapImageLoaded(const MapImage& img)
+{
+	return !img.levels.empty();
+}
+
+int getMapImageLevel(const MapImage& img, double scale)
+{
+	if (img.levels.empty() || scale >= 1.0) return 0;
+
+	// Largest level that still has at least one texel per screen pixel
+	int level = static_cast<int>(floor(log2(1.0 / scale)));
+
+	return std::max(0, std::min(level, static_cast<int>(img.levels.size()) - 1));
+}
+
+void drawMapImage(MapImage& img, const View::ViewPort& v, const vec2d& tl, const vec2d& br)
+{
+	if (img.levels.empty()) return;
+
+	int l = getMapImageLevel(img, v.scale);
+	ImagePageLevel& level = img.levels[l];
+	const uint64_t stamp = nextTextureUseStamp();
+	bool stalled = false;
+	const double factor = static_cast<double>(1 << l); // World pixels per level pixel
+	const double page_world = img.page_size * factor;
+
+	int c0 = std::max(0, static_cast<int>(floor(tl.x / page_world)));
+	int r0 = std::max(0, static_cast<int>(floor(tl.y / page_world)));
+	int c1 = std::min(level.cols - 1, static_cast<int>(floor((br.x - 1) / page_world)));
+	int r1 = std::min(level.rows - 1, static_cast<int>(floor((br.y - 1) / page_world)));
+
+	al_hold_bitmap_drawing(true);
+
+	for (int r = r0; r <= r1; ++r)
+	{
+		for (int c = c0; c <= c1; ++c)
+		{
+			int i = r * level.cols + c;
+			level.last_used[i] = stamp;
+
+			if (!level.pages[i])
+			{
+				// Evicted or never uploaded, this draw waits on it
+				al_hold_bitmap_drawing(false);
+				bool uploaded = uploadImagePage(img, l, c, r);
+				al_hold_bitmap_drawing(true);
+
+				if (!uploaded) continue;
+
+				countTextureReload();
+				stalled = true;
+			}
+
+			ALLEGRO_BITMAP* page = level.pages[i];
+
+			// Part of the page inside the requested world rect
+			vec2d p_tl(c * page_world, r * page_world);
+			vec2d p_br = p_tl + vec2d(al_get_bitmap_width(page) * factor, al_get_bitmap_height(page) * factor);
+			vec2d d_tl(std::max(p_tl.x, tl.x), std::max(p_tl.y, tl.y));
+			vec2d d_br(std::min(p_br.x, br.x), std::min(p_br.y, br.y));
+
+			if (d_tl.x >= d_br.x || d_tl.y >= d_br.y) continue;
+
+			View::drawScaledBitmapRegion(v, page, (d_tl - p_tl) / factor, (d_br - d_tl) / factor, d_tl, d_br - d_tl, 0);
+		}
+	}
+
+	al_hold_bitmap_drawing(false);
+
+	if (stalled) countTextureReloadStall();
+
+	evictImagePages(img, stamp);
+}
+
+void drawMapImagePreview(const MapImage& img, const View::ViewPort& v)
+{
+	if (img.levels.empty()) return;
+
+	const int l = static_cast<int>(img.levels.size()) - 1;
+	const ImagePageLevel& level = img.levels[l];
+	const double factor = static_cast<double>(1 << l);
+	const double page_world = img.page_size * factor;
+
+	al_hold_bitmap_drawing(true);
+
+	for (int r = 0; r < level.rows; ++r)
+	{
+		for (int c = 0; c < level.cols; ++c)
+		{
+			ALLEGRO_BITMAP* page = level.pages[r * level.cols + c];
+			if (!page) continue;
+
+			vec2d size(al_get_bitmap_width(page), al_get_bitmap_height(page));
+			View::drawTintedScaledBitmapRegion(v, page, vec2d(0, 0), size, vec2d(c * page_world, r * page_world), size * factor, al_map_rgb(128, 128, 128), 0);
+		}
+	}
+
+	al_hold_bitmap_drawing(false);
+}
@@ -0,0 +1,86 @@
+#include "mapped_file.hpp"
+
+#ifdef WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef WIN32
+	HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(f, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(f);
+		return false;
+	}
+
+	HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m)
+	{
+		CloseHandle(f);
+		return false;
+	}
+
+	void* view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(m);
+		CloseHandle(f);
+		return false;
+	}
+
+	file = f;
+	mapping = m;
+	ptr = static_cast<const uint8_t*>(view);
+	len = static_cast<size_t>(file_size.QuadPart);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping keeps the file alive
+
+	if (view == MAP_FAILED) return false;
+
+	ptr = static_cast<const uint8_t*>(view);
+	len = static_cast<size_t>(st.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (!ptr) return;
+
+#ifdef WIN32
+	UnmapViewOfFile(ptr);
+	CloseHandle(mapping);
+	CloseHandle(file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	munmap(const_cast<uint8_t*>(ptr), len);
+#endif
+
+	ptr = nullptr;
+	len = 0;
+}
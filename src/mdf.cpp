@@ -0,0 +1,707 @@
+#include "mdf.hpp"
+#include "util.hpp"
+#include "mapped_file.hpp"
+#include "byte_io.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <vector>
+#include <algorithm> // std::min
+#include <cstdio> // FILE
+#include <cstring> // memcpy, memcmp
+#include <new> // std::bad_alloc
+
+namespace fs = std::filesystem;
+
+constexpr uint8_t MDF_MAGIC[3] = {'M', 'D', 'F'};
+constexpr size_t MDF_HEADER_SIZE = 32;
+constexpr size_t MDF_SECTION_ENTRY_SIZE = 24;
+constexpr size_t MDF_BLOCK_ENTRY_SIZE = 20;
+constexpr uint32_t MDF_MAX_PATH = 1 << 16;
+constexpr int64_t MDF_MAX_SIDE = 1 << 15;
+constexpr int64_t MDF_MAX_TILES = int64_t(1) << 28; // A 32 MiB bitset, the fog mask is 4 bytes a tile on top of that
+constexpr uint64_t MDF_COMPACT_RATIO = 2;		// Appending stops once the file is this many times its live data
+constexpr uint64_t MDF_COMPACT_SLACK = 64 * 1024;	// plus this, so small maps aren't rewritten every save
+
+constexpr char TAG_INFO[4] = {'I', 'N', 'F', 'O'};
+constexpr char TAG_VIS[4] = {'V', 'I', 'S', ' '};
+constexpr char TAG_JRNL[4] = {'J', 'R', 'N', 'L'};
+
+struct SectionEntry
+{
+	char tag[4];
+	uint32_t crc;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct BlockEntry
+{
+	uint64_t offset;
+	uint32_t size;
+	uint32_t crc;
+	uint8_t encoding;
+};
+
+static void writeRawBlock(ByteWriter& w, const TileBitset& tiles, int y0, int y1)
+{
+	for (int y = y0; y < y1; ++y)
+	{
+		const uint64_t* row = tiles.row(y);
+		for (size_t i = 0; i < tiles.wordsPerRow(); ++i) w.u64(row[i]);
+	}
+}
+
+// Returns false as soon as the runs get bigger than limit bytes, raw is smaller then
+static bool writeRleBlock(ByteWriter& w, const TileBitset& tiles, int y0, int y1, size_t limit)
+{
+	size_t start = w.pos();
+	bool value = false;
+	uint64_t run = 0;
+
+	for (int y = y0; y < y1; ++y)
+	{
+		int x = 0;
+		while (x < tiles.width())
+		{
+			int end = tiles.findSpan(y, x, tiles.width() - 1, !value);
+			run += end - x;
+			x = end;
+
+			if (x < tiles.width())
+			{
+				w.varint(run);
+				if (w.pos() - start > limit) return false;
+				run = 0;
+				value = !value;
+			}
+		}
+	}
+
+	w.varint(run);
+
+	return w.pos() - start <= limit;
+}
+
+static bool readRleBlock(ByteReader& r, TileBitset& tiles, int y0, int y1)
+{
+	const uint64_t width = static_cast<uint64_t>(tiles.width());
+	const uint64_t total = width * static_cast<uint64_t>(y1 - y0);
+	uint64_t pos = 0;
+	bool value = false;
+
+	while (pos < total && r.ok)
+	{
+		uint64_t run = r.varint();
+		if (run > total - pos) return false;
+
+		if (value)
+		{
+			// Split the run at row ends
+			uint64_t p = pos, end = pos + run;
+			while (p < end)
+			{
+				int y = y0 + static_cast<int>(p / width);
+				int x0 = static_cast<int>(p % width);
+				uint64_t n = std::min(end - p, width - x0);
+				tiles.setSpan(y, x0, x0 + static_cast<int>(n) - 1, true);
+				p += n;
+			}
+		}
+
+		pos += run;
+		value = !value;
+	}
+
+	return r.ok && pos == total && r.pos == r.size;
+}
+
+static bool isLittleEndian()
+{
+	const uint16_t one = 1;
+	uint8_t first;
+	memcpy(&first, &one, 1);
+	return first == 1;
+}
+
+// Size was checked against the band when the index was validated
+static void readRawBlock(const uint8_t* data, TileBitset& tiles, int y0, int y1)
+{
+	const size_t stride = tiles.wordsPerRow();
+	if (stride == 0) return;
+
+	// Rows are contiguous in the bitset too, so a little-endian host copies the band in one go
+	if (isLittleEndian())
+	{
+		memcpy(tiles.row(y0), data, static_cast<size_t>(y1 - y0) * stride * sizeof(uint64_t));
+	}
+	else
+	{
+		ByteReader r(data, static_cast<size_t>(y1 - y0) * stride * sizeof(uint64_t));
+		for (int y = y0; y < y1; ++y)
+		{
+			uint64_t* row = tiles.row(y);
+			for (size_t i = 0; i < stride; ++i) row[i] = r.u64();
+		}
+	}
+
+	// Keep the padding bits past the last tile clear, the bitset relies on it
+	const int tail = tiles.width() & 63;
+	if (!tail) return;
+
+	const uint64_t last_mask = (uint64_t(1) << tail) - 1;
+	for (int y = y0; y < y1; ++y) tiles.row(y)[stride - 1] &= last_mask;
+}
+
+// Encodes band b of tiles at the end of w, whichever of the encodings is smallest
+static void writeBlock(ByteWriter& w, const TileBitset& tiles, int b, BlockEntry& e)
+{
+	int y0 = b * MDF_BLOCK_ROWS;
+	int y1 = std::min(tiles.height(), y0 + MDF_BLOCK_ROWS);
+	size_t shown = tiles.countRect(vec2i(0, y0), vec2i(tiles.width() - 1, y1 - 1));
+	size_t area = static_cast<size_t>(tiles.width()) * (y1 - y0);
+	size_t start = w.pos();
+
+	if (shown == 0 || tiles.width() == 0)
+	{
+		e.encoding = MDF_BLOCK_HIDDEN;
+	}
+	else if (shown == area)
+	{
+		e.encoding = MDF_BLOCK_SHOWN;
+	}
+	else
+	{
+		size_t raw_bytes = tiles.wordsPerRow() * sizeof(uint64_t) * (y1 - y0);
+		e.encoding = MDF_BLOCK_RLE;
+
+		if (!writeRleBlock(w, tiles, y0, y1, raw_bytes))
+		{
+			w.buf.resize(start);
+			e.encoding = MDF_BLOCK_RAW;
+			writeRawBlock(w, tiles, y0, y1);
+		}
+	}
+
+	e.offset = w.base + start;
+	e.size = static_cast<uint32_t>(w.pos() - start);
+	e.crc = crc32(w.buf.data() + start, e.size);
+}
+
+// INFO, the VIS index, JRNL if the map has a journal and the section table, returns the table's file offset
+static uint64_t writeSections(ByteWriter& w, const MapFileInfo& info, const std::vector<BlockEntry>& blocks, uint32_t& section_count)
+{
+	SectionEntry sections[3] = {};
+	section_count = 2;
+
+	memcpy(sections[0].tag, TAG_INFO, 4);
+	sections[0].offset = w.pos();
+	w.f64(info.view_pos.x);
+	w.f64(info.view_pos.y);
+	w.f64(info.view_scale);
+	w.u32(static_cast<uint32_t>(info.width));
+	w.u32(static_cast<uint32_t>(info.height));
+	w.u32(static_cast<uint32_t>(info.tile_size));
+	w.u32(static_cast<uint32_t>(info.image_path.size()));
+	w.bytes(info.image_path.data(), info.image_path.size());
+	sections[0].size = w.pos() - sections[0].offset;
+
+	memcpy(sections[1].tag, TAG_VIS, 4);
+	sections[1].offset = w.pos();
+	w.u32(static_cast<uint32_t>(info.width));
+	w.u32(static_cast<uint32_t>(info.height));
+	w.u32(MDF_BLOCK_ROWS);
+	w.u32(static_cast<uint32_t>(blocks.size()));
+	for (const BlockEntry& e : blocks)
+	{
+		w.u64(e.offset);
+		w.u32(e.size);
+		w.u32(e.crc);
+		w.u8(e.encoding);
+		w.u8(0);
+		w.u8(0);
+		w.u8(0);
+	}
+	sections[1].size = w.pos() - sections[1].offset;
+
+	if (info.journal_id != 0)
+	{
+		memcpy(sections[2].tag, TAG_JRNL, 4);
+		sections[2].offset = w.pos();
+		w.u64(info.journal_id);
+		w.u64(info.journal_seq);
+		sections[2].size = w.pos() - sections[2].offset;
+		++section_count;
+	}
+
+	const size_t table_pos = w.pos();
+	for (uint32_t i = 0; i < section_count; ++i)
+	{
+		SectionEntry& s = sections[i];
+		s.crc = crc32(w.buf.data() + s.offset, static_cast<size_t>(s.size));
+		w.bytes(s.tag, 4);
+		w.u32(s.crc);
+		w.u64(w.base + s.offset);
+		w.u64(s.size);
+	}
+	w.u32(crc32(w.buf.data() + table_pos, w.pos() - table_pos));
+
+	return w.base + table_pos;
+}
+
+static void writeHeader(uint8_t* header, uint64_t table_offset, uint32_t section_count)
+{
+	ByteWriter w;
+	w.bytes(MDF_MAGIC, 3);
+	w.u16(MDF_VERSION_2);
+	w.buf.resize(8, 0);
+	w.u64(table_offset);
+	w.u32(section_count);
+	w.u32(crc32(w.buf.data(), 20));
+	w.buf.resize(MDF_HEADER_SIZE, 0);
+
+	memcpy(header, w.buf.data(), MDF_HEADER_SIZE);
+}
+
+static bool checkMapSize(int64_t width, int64_t height)
+{
+	if (width < 0 || height < 0 || width > MDF_MAX_SIDE || height > MDF_MAX_SIDE || width * height > MDF_MAX_TILES)
+	{
+		std::cerr << "Map size " << width << "x" << height << " is out of range" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool writeMapData(const MapFileInfo& info, const TileBitset& tiles, std::vector<uint8_t>& out)
+{
+	if (tiles.width() != info.width || tiles.height() != info.height)
+	{
+		std::cerr << "Map tiles don't match the map size, not saving" << std::endl;
+		return false;
+	}
+
+	// Nothing gets written that couldn't be read back
+	if (!checkMapSize(info.width, info.height)) return false;
+
+	const int block_count = (info.height + MDF_BLOCK_ROWS - 1) / MDF_BLOCK_ROWS;
+
+	ByteWriter w;
+	w.buf.reserve(MDF_HEADER_SIZE + 4096 + block_count * MDF_BLOCK_ENTRY_SIZE);
+	w.buf.resize(MDF_HEADER_SIZE, 0); // Filled in last
+
+	// Block data first, so the index can point back at it
+	std::vector<BlockEntry> blocks(block_count);
+	for (int b = 0; b < block_count; ++b) writeBlock(w, tiles, b, blocks[b]);
+
+	uint32_t section_count = 0;
+	uint64_t table_offset = writeSections(w, info, blocks, section_count);
+	writeHeader(w.buf.data(), table_offset, section_count);
+
+	out = std::move(w.buf);
+	return true;
+}
+
+bool writeMapFile(const std::string& file, const MapFileInfo& info, const TileBitset& tiles)
+{
+	std::vector<uint8_t> bytes;
+	if (!writeMapData(info, tiles, bytes)) return false;
+
+	// Written next to the old file and renamed over it, so a crash leaves one or the other
+	const std::string temp = file + ".tmp";
+	FILE* out = fopen(temp.c_str(), "wb");
+	if (!out)
+	{
+		std::cerr << "Failed to open map file for writing: " << temp << std::endl;
+		return false;
+	}
+
+	bool ok = fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size() && syncFile(out);
+	ok = fclose(out) == 0 && ok;
+
+	std::error_code ec;
+	if (ok) fs::rename(temp, file, ec);
+
+	if (!ok || ec)
+	{
+		std::cerr << "Failed to write map file: " << file << std::endl;
+		fs::remove(temp, ec);
+		return false;
+	}
+
+	syncDirectory(fs::path(file).parent_path().string());
+
+	return true;
+}
+
+// A file can't declare more than MDF_MAX_TILES, but that still might not fit
+static bool allocateTiles(TileBitset& tiles, int width, int height)
+{
+	try
+	{
+		tiles.assign(width, height, false);
+	}
+	catch (const std::bad_alloc&)
+	{
+		std::cerr << "Not enough memory for a " << width << "x" << height << " map" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Packs 8 tile bytes into 8 bits, any non-zero byte counts as shown
+static uint8_t packTileBytes(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+
+	// High bit of each byte set if the byte was non-zero, then gathered into the top byte
+	constexpr uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+	uint64_t nz = (((v & low7) + low7) | v) & ~low7;
+	uint8_t bits = static_cast<uint8_t>(((nz >> 7) * 0x0102040810204080ULL) >> 56);
+
+	// The multiply moves byte i to bit i of a little-endian load, a big-endian load comes out reversed
+	if (!isLittleEndian())
+	{
+		bits = static_cast<uint8_t>(((bits * 0x0202020202ULL) & 0x010884422010ULL) % 1023);
+	}
+	return bits;
+}
+
+// Native-endian structs and a byte per tile, from before 0x0200
+static bool readMapFileV1(const uint8_t* bytes, size_t size, MapFileInfo& info, TileBitset& tiles)
+{
+	size_t pos = 5;
+	auto take = [&](void* dst, size_t n)
+	{
+		if (n > size - pos) return false;
+		memcpy(dst, bytes + pos, n);
+		pos += n;
+		return true;
+	};
+
+	uint64_t path_sz = 0;
+	if (!take(&info.view_pos, sizeof(info.view_pos)) || !take(&info.view_scale, sizeof(info.view_scale)) ||
+		!take(&path_sz, sizeof(path_sz)) || path_sz > MDF_MAX_PATH || path_sz > size - pos)
+	{
+		return false;
+	}
+
+	info.image_path.assign(reinterpret_cast<const char*>(bytes + pos), static_cast<size_t>(path_sz));
+	pos += static_cast<size_t>(path_sz);
+
+	if (!take(&info.width, sizeof(info.width)) || !take(&info.height, sizeof(info.height)) || !take(&info.tile_size, sizeof(info.tile_size)) ||
+		!checkMapSize(info.width, info.height))
+	{
+		return false;
+	}
+
+	// Every tile has to be there, checked before anything is allocated
+	const size_t tile_count = static_cast<size_t>(info.width) * static_cast<size_t>(info.height);
+	if (size - pos != tile_count || !allocateTiles(tiles, info.width, info.height)) return false;
+
+	const uint8_t* tile_bytes = bytes + pos;
+	for (int y = 0; y < info.height; ++y)
+	{
+		const uint8_t* src = tile_bytes + static_cast<size_t>(y) * info.width;
+		uint64_t* row = tiles.row(y);
+
+		int x = 0;
+		for (; x + 64 <= info.width; x += 64)
+		{
+			uint64_t word = 0;
+			for (int i = 0; i < 8; ++i) word |= static_cast<uint64_t>(packTileBytes(src + x + i * 8)) << (i * 8);
+			row[x >> 6] = word;
+		}
+		for (; x < info.width; ++x)
+		{
+			if (src[x]) tiles.set(x, y, true);
+		}
+	}
+
+	info.version = MDF_VERSION_1;
+	return true;
+}
+
+static bool readInfoSection(ByteReader r, MapFileInfo& info)
+{
+	info.view_pos.x = r.f64();
+	info.view_pos.y = r.f64();
+	info.view_scale = r.f64();
+	info.width = r.i32();
+	info.height = r.i32();
+	info.tile_size = r.i32();
+
+	uint32_t path_sz = r.u32();
+	if (!r.ok || path_sz > MDF_MAX_PATH) return false;
+
+	const uint8_t* path = r.bytes(path_sz);
+	if (!path) return false;
+	info.image_path.assign(reinterpret_cast<const char*>(path), path_sz);
+
+	return info.tile_size > 0 && checkMapSize(info.width, info.height);
+}
+
+// Checks the whole index against the file before the bitset is allocated
+static bool readVisIndex(ByteReader r, const uint8_t* bytes, size_t size, const MapFileInfo& info, std::vector<BlockEntry>& blocks, uint32_t& block_rows, bool check_blocks)
+{
+	uint32_t width = r.u32();
+	uint32_t height = r.u32();
+	block_rows = r.u32();
+	uint32_t block_count = r.u32();
+
+	if (!r.ok || static_cast<int>(width) != info.width || static_cast<int>(height) != info.height || block_rows == 0 ||
+		block_count != (static_cast<uint64_t>(height) + block_rows - 1) / block_rows || block_count > (r.size - r.pos) / MDF_BLOCK_ENTRY_SIZE)
+	{
+		return false;
+	}
+
+	const size_t row_bytes = ((static_cast<size_t>(width) + 63) / 64) * sizeof(uint64_t);
+	blocks.resize(block_count);
+
+	for (uint32_t b = 0; b < block_count; ++b)
+	{
+		BlockEntry& e = blocks[b];
+		e.offset = r.u64();
+		e.size = r.u32();
+		e.crc = r.u32();
+		e.encoding = r.u8();
+		r.bytes(3);
+
+		if (!r.ok || e.offset > size || e.size > size - e.offset) return false;
+
+		uint64_t rows = std::min<uint64_t>(height - static_cast<uint64_t>(b) * block_rows, block_rows);
+		switch (e.encoding)
+		{
+			case MDF_BLOCK_HIDDEN:
+			case MDF_BLOCK_SHOWN:
+			case MDF_BLOCK_RLE:
+			break;
+
+			case MDF_BLOCK_RAW:
+				if (e.size != rows * row_bytes) return false;
+			break;
+
+			default:
+				std::cerr << "Unknown map visibility block encoding: " << static_cast<int>(e.encoding) << std::endl;
+			return false;
+		}
+
+		if (check_blocks && crc32(bytes + e.offset, e.size) != e.crc)
+		{
+			std::cerr << "Map visibility block " << b << " failed its checksum" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Validates everything up to the block data, which is only checksummed if check_blocks is set
+static bool readMapIndex(const uint8_t* bytes, size_t size, MapFileInfo& info, std::vector<BlockEntry>& blocks, uint32_t& block_rows, bool check_blocks)
+{
+	if (size < MDF_HEADER_SIZE) return false;
+
+	ByteReader header(bytes, size);
+	header.bytes(8);
+	uint64_t table_offset = header.u64();
+	uint32_t section_count = header.u32();
+	uint32_t header_crc = header.u32();
+
+	if (!header.ok || crc32(bytes, 20) != header_crc) return false;
+	if (table_offset > size || section_count > (size - table_offset) / MDF_SECTION_ENTRY_SIZE) return false;
+
+	ByteReader table(bytes + table_offset, size - table_offset);
+	const uint8_t* table_bytes = table.bytes(section_count * MDF_SECTION_ENTRY_SIZE);
+	if (!table_bytes || table.u32() != crc32(table_bytes, section_count * MDF_SECTION_ENTRY_SIZE)) return false;
+	table.pos = 0;
+
+	// Every section is bounds and checksum checked before any of them is parsed
+	bool have_info = false;
+	bool have_vis = false;
+	SectionEntry info_section = {};
+	SectionEntry vis_section = {};
+
+	for (uint32_t i = 0; i < section_count; ++i)
+	{
+		SectionEntry s;
+		memcpy(s.tag, table.bytes(4), 4);
+		s.crc = table.u32();
+		s.offset = table.u64();
+		s.size = table.u64();
+
+		if (s.offset > size || s.size > size - s.offset) return false;
+		if (crc32(bytes + s.offset, static_cast<size_t>(s.size)) != s.crc)
+		{
+			std::cerr << "Map section " << std::string(s.tag, 4) << " failed its checksum" << std::endl;
+			return false;
+		}
+
+		if (memcmp(s.tag, TAG_INFO, 4) == 0)
+		{
+			info_section = s;
+			have_info = true;
+		}
+		else if (memcmp(s.tag, TAG_VIS, 4) == 0)
+		{
+			vis_section = s;
+			have_vis = true;
+		}
+		else if (memcmp(s.tag, TAG_JRNL, 4) == 0)
+		{
+			ByteReader jrnl(bytes + s.offset, static_cast<size_t>(s.size));
+			info.journal_id = jrnl.u64();
+			info.journal_seq = jrnl.u64();
+			if (!jrnl.ok) return false;
+		}
+	}
+
+	if (!have_info || !have_vis) return false;
+	if (!readInfoSection(ByteReader(bytes + info_section.offset, static_cast<size_t>(info_section.size)), info)) return false;
+
+	return readVisIndex(ByteReader(bytes + vis_section.offset, static_cast<size_t>(vis_section.size)), bytes, size, info, blocks, block_rows, check_blocks);
+}
+
+static bool readMapFileV2(const uint8_t* bytes, size_t size, MapFileInfo& info, TileBitset& tiles)
+{
+	std::vector<BlockEntry> blocks;
+	uint32_t block_rows = 0;
+	if (!readMapIndex(bytes, size, info, blocks, block_rows, true) || !allocateTiles(tiles, info.width, info.height)) return false;
+
+	for (size_t b = 0; b < blocks.size(); ++b)
+	{
+		const BlockEntry& e = blocks[b];
+		int y0 = static_cast<int>(b * block_rows);
+		int y1 = static_cast<int>(std::min<uint64_t>(info.height, static_cast<uint64_t>(y0) + block_rows));
+
+		switch (e.encoding)
+		{
+			case MDF_BLOCK_SHOWN:
+				tiles.setRect(vec2i(0, y0), vec2i(info.width - 1, y1 - 1), true);
+			break;
+
+			case MDF_BLOCK_RAW:
+				readRawBlock(bytes + e.offset, tiles, y0, y1);
+			break;
+
+			case MDF_BLOCK_RLE:
+			{
+				ByteReader block(bytes + e.offset, e.size);
+				if (!readRleBlock(block, tiles, y0, y1)) return false;
+			}
+			break;
+
+			default:
+			break;
+		}
+	}
+
+	info.version = MDF_VERSION_2;
+	return true;
+}
+
+bool readMapData(const uint8_t* data, size_t size, MapFileInfo& info, TileBitset& tiles)
+{
+	if (size < 5 || memcmp(data, MDF_MAGIC, 3) != 0)
+	{
+		std::cerr << "Not a map file" << std::endl;
+		return false;
+	}
+
+	// 0x0100 files stored the version natively, which was little-endian on every platform we shipped
+	uint16_t file_version = static_cast<uint16_t>(data[3] | (data[4] << 8));
+	bool ok = false;
+
+	switch (file_version)
+	{
+		case MDF_VERSION_1:
+			ok = readMapFileV1(data, size, info, tiles);
+		break;
+
+		case MDF_VERSION_2:
+			ok = readMapFileV2(data, size, info, tiles);
+		break;
+
+		default:
+			std::cerr << "Unsupported map file version " << std::hex << file_version << std::dec << std::endl;
+		return false;
+	}
+
+	// Don't hand back half a map
+	if (!ok) tiles.clear();
+
+	return ok;
+}
+
+bool readMapFile(const std::string& file, MapFileInfo& info, TileBitset& tiles)
+{
+	MappedFile mapped;
+	if (!mapped.open(file))
+	{
+		std::cerr << "Failed to open map file: " << file << std::endl;
+		return false;
+	}
+
+	if (!readMapData(mapped.data(), mapped.size(), info, tiles))
+	{
+		std::cerr << "Failed to load map file: " << file << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool appendMapFile(const std::string& file, const MapFileInfo& info, const TileBitset& tiles, const std::vector<bool>& dirty_blocks, uint64_t expected_size)
+{
+	const int block_count = (info.height + MDF_BLOCK_ROWS - 1) / MDF_BLOCK_ROWS;
+	if (tiles.width() != info.width || tiles.height() != info.height || dirty_blocks.size() != static_cast<size_t>(block_count)) return false;
+
+	std::vector<BlockEntry> blocks;
+	uint64_t file_size = 0;
+	uint64_t live_bytes = MDF_HEADER_SIZE;
+	{
+		MappedFile mapped;
+		if (!mapped.open(file) || mapped.size() != expected_size) return false;
+		if (mapped.size() < MDF_HEADER_SIZE || memcmp(mapped.data(), MDF_MAGIC, 3) != 0 || mapped.data()[3] != (MDF_VERSION_2 & 0xFF) || mapped.data()[4] != (MDF_VERSION_2 >> 8)) return false;
+
+		MapFileInfo old_info;
+		uint32_t block_rows = 0;
+		if (!readMapIndex(mapped.data(), mapped.size(), old_info, blocks, block_rows, false)) return false;
+		if (old_info.width != info.width || old_info.height != info.height || block_rows != MDF_BLOCK_ROWS) return false;
+
+		file_size = mapped.size();
+	}
+
+	ByteWriter w;
+	w.base = file_size;
+
+	for (int b = 0; b < block_count; ++b)
+	{
+		if (dirty_blocks[b]) writeBlock(w, tiles, b, blocks[b]);
+		live_bytes += blocks[b].size;
+	}
+
+	uint32_t section_count = 0;
+	uint64_t table_offset = writeSections(w, info, blocks, section_count);
+	size_t blocks_end = static_cast<size_t>(table_offset - w.base);
+	live_bytes += w.pos() - blocks_end;
+
+	// Rewrite instead once most of the file is blocks and tables nothing points at anymore
+	if (file_size + w.pos() > live_bytes * MDF_COMPACT_RATIO + MDF_COMPACT_SLACK) return false;
+
+	uint8_t header[MDF_HEADER_SIZE];
+	writeHeader(header, table_offset, section_count);
+
+	FILE* f = fopen(file.c_str(), "r+b");
+	if (!f) return false;
+
+	// The old header still points at the old table until the new one is on disk,
+	// so a crash before the header write loses the save but not the file
+	bool ok = fseek(f, 0, SEEK_END) == 0 && fwrite(w.buf.data(), 1, w.buf.size(), f) == w.buf.size() && syncFile(f);
+	ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(header, 1, MDF_HEADER_SIZE, f) == MDF_HEADER_SIZE && syncFile(f);
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok) std::cerr << "Failed to append to map file: " << file << std::endl;
+
+	return ok;
+}
@@ -0,0 +1,67 @@
+#include "texture_budget.hpp"
+
+#include <atomic>
+
+static std::atomic<uint64_t> budget{TEXTURE_BUDGET_DEFAULT};
+static std::atomic<uint64_t> resident_bytes{0};
+static std::atomic<uint64_t> evictions{0};
+static std::atomic<uint64_t> reloads{0};
+static std::atomic<uint64_t> reload_stalls{0};
+static std::atomic<uint64_t> use_stamp{0};
+
+void setTextureBudget(uint64_t bytes)
+{
+	budget = bytes;
+}
+
+uint64_t getTextureBudget()
+{
+	return budget;
+}
+
+TextureBudgetStats getTextureBudgetStats()
+{
+	TextureBudgetStats stats;
+	stats.budget = budget;
+	stats.resident_bytes = resident_bytes;
+	stats.evictions = evictions;
+	stats.reloads = reloads;
+	stats.reload_stalls = reload_stalls;
+
+	return stats;
+}
+
+bool isOverTextureBudget(uint64_t extra_bytes)
+{
+	return resident_bytes + extra_bytes > budget;
+}
+
+uint64_t nextTextureUseStamp()
+{
+	return ++use_stamp;
+}
+
+void addResidentTextureBytes(uint64_t bytes)
+{
+	resident_bytes += bytes;
+}
+
+void removeResidentTextureBytes(uint64_t bytes)
+{
+	resident_bytes -= bytes;
+}
+
+void countTextureEviction()
+{
+	++evictions;
+}
+
+void countTextureReload()
+{
+	++reloads;
+}
+
+void countTextureReloadStall()
+{
+	++reload_stalls;
+}
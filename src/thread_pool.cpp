@@ -0,0 +1,106 @@
+#include "thread_pool.hpp"
+
+#include <algorithm> // std::min
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned threads) : stopping(false)
+{
+	if (threads == 0)
+	{
+		unsigned hw = std::thread::hardware_concurrency();
+		threads = hw > 1 ? hw - 1 : 1;
+	}
+
+	for (unsigned i = 0; i < threads; ++i) workers.emplace_back([this]() { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		tasks.clear(); // Anything still queued is dropped, tasks own their state
+	}
+	cv.notify_all();
+
+	for (auto &t : workers) t.join();
+}
+
+void ThreadPool::submit(std::function<void(void)> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	cv.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void(void)> task;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+			if (stopping) return;
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& fn)
+{
+	if (n == 0) return;
+
+	// Helpers may start after the loop is finished, so the shared state is reference counted
+	struct Shared
+	{
+		std::atomic<size_t> next{0};
+		std::atomic<size_t> done{0};
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::function<void(size_t)> fn;
+		size_t n;
+	};
+
+	auto shared = std::make_shared<Shared>();
+	shared->fn = fn;
+	shared->n = n;
+
+	auto work = [](Shared& s)
+	{
+		size_t i;
+		while ((i = s.next++) < s.n)
+		{
+			s.fn(i);
+
+			if (++s.done == s.n)
+			{
+				std::lock_guard<std::mutex> lock(s.mutex);
+				s.cv.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(n - 1, static_cast<size_t>(workers.size()));
+	for (size_t h = 0; h < helpers; ++h) submit([shared, work]() { work(*shared); });
+
+	work(*shared);
+
+	std::unique_lock<std::mutex> lock(shared->mutex);
+	shared->cv.wait(lock, [&shared]() { return shared->done == shared->n; });
+}
+
+ThreadPool& getWorkerPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
@@ -0,0 +1,316 @@
+#include "tile_bitset.hpp"
+
+#include <algorithm> // std::min, std::max, std::fill
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define AXE_POPCOUNT_AVX2
+	#include <immintrin.h>
+#endif
+
+constexpr uint64_t ALL_BITS = ~uint64_t(0);
+
+// Bits [lo, hi] of a word, 0 <= lo <= hi <= 63
+static inline uint64_t bitMask(int lo, int hi)
+{
+	uint64_t upper = (hi == 63) ? ALL_BITS : ((uint64_t(1) << (hi + 1)) - 1);
+	return upper & (ALL_BITS << lo);
+}
+
+// Bits of the last word in a row that belong to the map
+static inline uint64_t tailMask(int width)
+{
+	int used = width & 63;
+	return used ? ((uint64_t(1) << used) - 1) : ALL_BITS;
+}
+
+// Reads n (1 - 64) bits starting at bit x of a row, the span may straddle two words
+static inline uint64_t readBits(const uint64_t* row, int x, int n)
+{
+	int wi = x >> 6;
+	int off = x & 63;
+
+	uint64_t v = row[wi] >> off;
+	if (off && off + n > 64) v |= row[wi + 1] << (64 - off);
+	if (n < 64) v &= (uint64_t(1) << n) - 1;
+
+	return v;
+}
+
+// Writes the low n (1 - 64) bits of v at bit x of a row
+static inline void writeBits(uint64_t* row, int x, int n, uint64_t v)
+{
+	int wi = x >> 6;
+	int off = x & 63;
+	uint64_t mask = (n == 64) ? ALL_BITS : ((uint64_t(1) << n) - 1);
+	v &= mask;
+
+	row[wi] = (row[wi] & ~(mask << off)) | (v << off);
+	if (off && off + n > 64)
+	{
+		uint64_t spill = (uint64_t(1) << (off + n - 64)) - 1;
+		row[wi + 1] = (row[wi + 1] & ~spill) | (v >> (64 - off));
+	}
+}
+
+static inline size_t popcount64(uint64_t v)
+{
+#if defined(__GNUC__)
+	return static_cast<size_t>(__builtin_popcountll(v));
+#else
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return static_cast<size_t>((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+#ifdef AXE_POPCOUNT_AVX2
+// Nibble lookup popcount (Mula), 4 words per iteration. Only called when the
+// cpu reports AVX2, so the rest of the program does not need -mavx2.
+__attribute__((target("avx2")))
+static size_t popcountAVX2(const uint64_t* words, size_t n)
+{
+	const __m256i lookup = _mm256_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+	__m256i total = _mm256_setzero_si256();
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+		__m256i lo = _mm256_and_si256(v, low_nibble);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble);
+		__m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+		total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+	}
+
+	alignas(32) uint64_t lanes[4];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), total);
+	size_t sum = static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+
+	for (; i < n; ++i) sum += popcount64(words[i]);
+
+	return sum;
+}
+#endif
+
+size_t popcountWords(const uint64_t* words, size_t n)
+{
+#ifdef AXE_POPCOUNT_AVX2
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	if (has_avx2 && n >= 16) return popcountAVX2(words, n);
+#endif
+
+	size_t sum = 0;
+	for (size_t i = 0; i < n; ++i) sum += popcount64(words[i]);
+	return sum;
+}
+
+void TileBitset::assign(int width, int height, bool value)
+{
+	w = std::max(width, 0);
+	h = std::max(height, 0);
+	stride = (static_cast<size_t>(w) + 63) / 64;
+
+	data.assign(stride * h, 0);
+	if (value) fill(true);
+}
+
+void TileBitset::clear()
+{
+	w = 0;
+	h = 0;
+	stride = 0;
+	data.clear();
+}
+
+void TileBitset::fill(bool value)
+{
+	std::fill(data.begin(), data.end(), value ? ALL_BITS : 0);
+
+	if (value && stride > 0)
+	{
+		uint64_t tail = tailMask(w);
+		for (int y = 0; y < h; ++y) row(y)[stride - 1] &= tail;
+	}
+}
+
+bool TileBitset::clip(vec2i& tl, vec2i& br) const
+{
+	vec2i a = tl, b = br;
+
+	tl.x = std::max(std::min(a.x, b.x), 0);
+	tl.y = std::max(std::min(a.y, b.y), 0);
+	br.x = std::min(std::max(a.x, b.x), w - 1);
+	br.y = std::min(std::max(a.y, b.y), h - 1);
+
+	return tl.x <= br.x && tl.y <= br.y;
+}
+
+void TileBitset::setSpan(int y, int x0, int x1, bool value)
+{
+	setRect(vec2i{x0, y}, vec2i{x1, y}, value);
+}
+
+size_t TileBitset::countSpan(int y, int x0, int x1) const
+{
+	return countRect(vec2i{x0, y}, vec2i{x1, y});
+}
+
+int TileBitset::findSpan(int y, int x0, int x1, bool value) const
+{
+	int end = x1 + 1;
+	if (y < 0 || y >= h) return end;
+
+	x0 = std::max(x0, 0);
+	x1 = std::min(x1, w - 1);
+	if (x0 > x1) return end;
+
+	const uint64_t* r = row(y);
+	uint64_t flip = value ? 0 : ALL_BITS;
+	int wa = x0 >> 6, wb = x1 >> 6;
+
+	for (int wi = wa; wi <= wb; ++wi)
+	{
+		int lo = (wi == wa) ? (x0 & 63) : 0;
+		int hi = (wi == wb) ? (x1 & 63) : 63;
+		uint64_t bits = (r[wi] ^ flip) & bitMask(lo, hi);
+
+		if (bits)
+		{
+#if defined(__GNUC__)
+			return (wi << 6) + __builtin_ctzll(bits);
+#else
+			int bit = 0;
+			while (!((bits >> bit) & 1)) ++bit;
+			return (wi << 6) + bit;
+#endif
+		}
+	}
+
+	return end;
+}
+
+void TileBitset::setRect(vec2i tl, vec2i br, bool value)
+{
+	if (!clip(tl, br)) return;
+
+	int wa = tl.x >> 6, wb = br.x >> 6;
+	uint64_t first = bitMask(tl.x & 63, wa == wb ? (br.x & 63) : 63);
+	uint64_t last = bitMask(0, br.x & 63);
+
+	for (int y = tl.y; y <= br.y; ++y)
+	{
+		uint64_t* r = row(y);
+
+		if (wa == wb)
+		{
+			r[wa] = value ? (r[wa] | first) : (r[wa] & ~first);
+			continue;
+		}
+
+		r[wa] = value ? (r[wa] | first) : (r[wa] & ~first);
+		std::fill(r + wa + 1, r + wb, value ? ALL_BITS : 0);
+		r[wb] = value ? (r[wb] | last) : (r[wb] & ~last);
+	}
+}
+
+size_t TileBitset::countRect(vec2i tl, vec2i br) const
+{
+	if (!clip(tl, br)) return 0;
+
+	int wa = tl.x >> 6, wb = br.x >> 6;
+	uint64_t first = bitMask(tl.x & 63, wa == wb ? (br.x & 63) : 63);
+	uint64_t last = bitMask(0, br.x & 63);
+	size_t sum = 0;
+
+	for (int y = tl.y; y <= br.y; ++y)
+	{
+		const uint64_t* r = row(y);
+
+		sum += popcount64(r[wa] & first);
+		if (wa != wb)
+		{
+			sum += popcountWords(r + wa + 1, wb - wa - 1);
+			sum += popcount64(r[wb] & last);
+		}
+	}
+
+	return sum;
+}
+
+bool TileBitset::testRect(vec2i tl, vec2i br, bool value) const
+{
+	if (!clip(tl, br)) return true;
+
+	int wa = tl.x >> 6, wb = br.x >> 6;
+	uint64_t first = bitMask(tl.x & 63, wa == wb ? (br.x & 63) : 63);
+	uint64_t last = bitMask(0, br.x & 63);
+	uint64_t flip = value ? ALL_BITS : 0; // Looking for any bit that differs from value
+
+	for (int y = tl.y; y <= br.y; ++y)
+	{
+		const uint64_t* r = row(y);
+
+		if ((r[wa] ^ flip) & first) return false;
+		if (wa == wb) continue;
+
+		for (int wi = wa + 1; wi < wb; ++wi)
+		{
+			if (r[wi] ^ flip) return false;
+		}
+		if ((r[wb] ^ flip) & last) return false;
+	}
+
+	return true;
+}
+
+TileBitset TileBitset::copyRect(vec2i tl, vec2i br) const
+{
+	if (!clip(tl, br)) return TileBitset();
+
+	TileBitset out(br.x - tl.x + 1, br.y - tl.y + 1);
+
+	for (int y = 0; y < out.h; ++y)
+	{
+		const uint64_t* src = row(tl.y + y);
+		uint64_t* dst = out.row(y);
+
+		for (int x = 0; x < out.w; x += 64)
+		{
+			dst[x >> 6] = readBits(src, tl.x + x, std::min(64, out.w - x));
+		}
+	}
+
+	return out;
+}
+
+void TileBitset::pasteRect(vec2i tl, const TileBitset& src)
+{
+	// Part of src that lands inside this bitset
+	int sx0 = std::max(0, -tl.x);
+	int sy0 = std::max(0, -tl.y);
+	int sx1 = std::min(src.w, w - tl.x) - 1;
+	int sy1 = std::min(src.h, h - tl.y) - 1;
+
+	if (sx0 > sx1 || sy0 > sy1) return;
+
+	for (int sy = sy0; sy <= sy1; ++sy)
+	{
+		const uint64_t* s = src.row(sy);
+		uint64_t* d = row(tl.y + sy);
+
+		for (int sx = sx0; sx <= sx1; sx += 64)
+		{
+			int n = std::min(64, sx1 - sx + 1);
+			writeBits(d, tl.x + sx, n, readBits(s, sx, n));
+		}
+	}
+}
+
+size_t TileBitset::count() const
+{
+	return popcountWords(data.data(), data.size());
+}
@@ -0,0 +1,112 @@
+#include "tile_diff.hpp"
+
+#include <algorithm> // std::min, std::max
+
+void writeTileRuns(ByteWriter& w, const TileBitset& tiles)
+{
+	bool value = false;
+	uint64_t run = 0;
+
+	for (int y = 0; y < tiles.height(); ++y)
+	{
+		int x = 0;
+		while (x < tiles.width())
+		{
+			int end = tiles.findSpan(y, x, tiles.width() - 1, !value);
+			run += end - x;
+			x = end;
+
+			if (x < tiles.width())
+			{
+				w.varint(run);
+				run = 0;
+				value = !value;
+			}
+		}
+	}
+
+	w.varint(run);
+}
+
+bool readTileRuns(ByteReader& r, TileBitset& tiles)
+{
+	const uint64_t total = tiles.size();
+	const uint64_t width = tiles.width();
+	uint64_t pos = 0;
+	bool value = false;
+
+	while (pos < total)
+	{
+		uint64_t run = r.varint();
+		if (!r.ok || run > total - pos) return false;
+
+		// A shown run can wrap over several rows
+		for (uint64_t i = pos, end = pos + run; value && i < end;)
+		{
+			uint64_t x = i % width;
+			uint64_t n = std::min(width - x, end - i);
+			tiles.setSpan(static_cast<int>(i / width), static_cast<int>(x), static_cast<int>(x + n - 1), true);
+			i += n;
+		}
+
+		pos += run;
+		value = !value;
+	}
+
+	return true;
+}
+
+void TileDiff::assign(vec2i top_left, const TileBitset& tiles)
+{
+	ByteWriter bw;
+	writeTileRuns(bw, tiles);
+
+	tl = top_left;
+	w = tiles.width();
+	h = tiles.height();
+	runs.assign(bw.buf.begin(), bw.buf.end());
+	runs.shrink_to_fit();
+}
+
+void TileDiff::assign(const std::vector<vec2i>& positions)
+{
+	if (positions.empty())
+	{
+		tl = {0, 0};
+		w = h = 0;
+		runs.clear();
+		return;
+	}
+
+	vec2i lo = positions.front(), hi = positions.front();
+	for (const vec2i& p : positions)
+	{
+		lo = {std::min(lo.x, p.x), std::min(lo.y, p.y)};
+		hi = {std::max(hi.x, p.x), std::max(hi.y, p.y)};
+	}
+
+	TileBitset mask(hi.x - lo.x + 1, hi.y - lo.y + 1);
+	for (const vec2i& p : positions) mask.set(p.x - lo.x, p.y - lo.y, true);
+
+	assign(lo, mask);
+}
+
+TileBitset TileDiff::decode() const
+{
+	if (empty()) return TileBitset();
+
+	TileBitset tiles(static_cast<int>(w), static_cast<int>(h));
+	ByteReader r(runs.data(), runs.size());
+	readTileRuns(r, tiles);
+	return tiles;
+}
+
+std::vector<vec2i> TileDiff::positions() const
+{
+	std::vector<vec2i> out;
+	forEachSpan([&out](int y, int x0, int x1)
+	{
+		for (int x = x0; x <= x1; ++x) out.push_back({x, y});
+	});
+	return out;
+}
@@ -0,0 +1,82 @@
+#include "tile_snapshot.hpp"
+
+#include <algorithm> // std::min
+
+std::shared_ptr<TileSnapshot> makeTileSnapshot(const Map& m, const TileSnapshot* prev, uint64_t since_stamp)
+{
+	// Edit stamps only grow, even across maps, so a band none of whose rows are newer than since_stamp can be shared
+	bool reuse = prev && prev->width == m.v_tiles.width() && prev->height == m.v_tiles.height();
+
+	auto snap = std::make_shared<TileSnapshot>();
+	snap->width = m.v_tiles.width();
+	snap->height = m.v_tiles.height();
+
+	const int block_count = (snap->height + TILE_SNAPSHOT_BLOCK_ROWS - 1) / TILE_SNAPSHOT_BLOCK_ROWS;
+	snap->blocks.resize(block_count);
+
+	for (int b = 0; b < block_count; ++b)
+	{
+		int y0 = b * TILE_SNAPSHOT_BLOCK_ROWS;
+		int y1 = std::min(y0 + TILE_SNAPSHOT_BLOCK_ROWS, snap->height) - 1;
+
+		bool changed = !reuse;
+		for (int y = y0; !changed && y <= y1; ++y)
+		{
+			changed = y >= static_cast<int>(m.row_stamps.size()) || m.row_stamps[y] > since_stamp;
+		}
+
+		if (changed) snap->blocks[b] = std::make_shared<const TileBitset>(m.v_tiles.copyRect({0, y0}, {snap->width - 1, y1}));
+		else snap->blocks[b] = prev->blocks[b];
+	}
+
+	return snap;
+}
+
+TileBitset flattenTileSnapshot(const TileSnapshot& snapshot)
+{
+	TileBitset tiles(snapshot.width, snapshot.height);
+	for (size_t b = 0; b < snapshot.blocks.size(); ++b)
+	{
+		tiles.pasteRect({0, static_cast<int>(b) * TILE_SNAPSHOT_BLOCK_ROWS}, *snapshot.blocks[b]);
+	}
+	return tiles;
+}
+
+size_t getTileSnapshotBlockSize(const TileSnapshot& snapshot, size_t block)
+{
+	const TileBitset& b = *snapshot.blocks[block];
+	return sizeof(TileBitset) + b.wordsPerRow() * b.height() * sizeof(uint64_t);
+}
+
+void TileSnapshotChannel::publish(const Map& m, uint64_t delta_seq)
+{
+	std::shared_ptr<const TileSnapshot> prev = std::atomic_load(&current);
+	if (prev && m.edit_stamp == published_stamp && prev->delta_seq == delta_seq && prev->width == m.v_tiles.width() && prev->height == m.v_tiles.height()) return;
+
+	std::shared_ptr<TileSnapshot> snap = makeTileSnapshot(m, prev.get(), published_stamp);
+	snap->version = prev ? prev->version + 1 : 1;
+	snap->delta_seq = delta_seq;
+
+	published_stamp = m.edit_stamp;
+	std::atomic_store(&current, std::shared_ptr<const TileSnapshot>(std::move(snap)));
+}
+
+std::shared_ptr<const TileSnapshot> TileSnapshotChannel::latest() const
+{
+	return std::atomic_load(&current);
+}
+
+bool applyTileSnapshot(Map& m, const TileSnapshot& snapshot, const TileSnapshot* applied)
+{
+	if (snapshot.width != m.v_tiles.width() || snapshot.height != m.v_tiles.height()) return false;
+
+	if (applied && (applied->width != snapshot.width || applied->height != snapshot.height)) applied = nullptr;
+
+	for (size_t b = 0; b < snapshot.blocks.size(); ++b)
+	{
+		if (applied && applied->blocks[b] == snapshot.blocks[b]) continue;
+		setTiles(m, {0, static_cast<int>(b) * TILE_SNAPSHOT_BLOCK_ROWS}, *snapshot.blocks[b]);
+	}
+
+	return true;
+}
@@ -2,11 +2,17 @@
 #include <iostream>
 #include <sstream>
 #include <stdlib.h>
+#include <time.h> // clock
+#include <array>
 
 #ifdef WIN32
 	#define WIN32_LEAN_AND_MEAN
 	#include <windows.h>
 	#include <shlobj.h>
+	#include <io.h> // _commit
+#else
+	#include <fcntl.h>
+	#include <unistd.h> // fsync
 #endif
 
 vec2i getScreenSize()
@@ -65,4 +71,93 @@ std::string getHomeDir()
 
     return std::string(env_var);
 #endif
-}
\ No newline at end of file
+}
+
+std::string getCacheDir()
+{
+#ifdef WIN32
+	const char* env_var = getenv("LOCALAPPDATA");
+	if (env_var) return std::string(env_var) + "/axe-map-editor/cache";
+#else
+	const char* env_var = getenv("XDG_CACHE_HOME");
+	if (env_var && *env_var) return std::string(env_var) + "/axe-map-editor";
+
+	env_var = getenv("HOME");
+	if (env_var) return std::string(env_var) + "/.cache/axe-map-editor";
+#endif
+	return "axe-cache";
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+	// FNV-1a, 64 bit
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+double getProcessCpuTime()
+{
+#ifdef WIN32
+	// clock() is wall time on Windows
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0.0;
+
+	auto toSeconds = [](const FILETIME& ft) { return ((static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 1e7; };
+	return toSeconds(kernel) + toSeconds(user);
+#else
+	return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc)
+{
+	// Reflected IEEE polynomial, same as zlib
+	static const auto table = []()
+	{
+		std::array<uint32_t, 256> t;
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			t[i] = c;
+		}
+		return t;
+	}();
+
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	crc = ~crc;
+
+	for (size_t i = 0; i < size; ++i) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+bool syncFile(FILE* f)
+{
+	if (fflush(f) != 0) return false;
+
+#ifdef WIN32
+	return _commit(_fileno(f)) == 0;
+#else
+	return fsync(fileno(f)) == 0;
+#endif
+}
+
+void syncDirectory(const std::string& dir)
+{
+#ifndef WIN32
+	int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	fsync(fd);
+	close(fd);
+#else
+	(void)dir; // Renames are durable once MoveFileEx returns
+#endif
+}
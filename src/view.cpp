@@ -1,5 +1,7 @@
 #include "view.hpp"
 
+#include <math.h> // sqrt
+
 namespace View
 {
 	vec2d worldToScreen(const vec2d& p, const ViewPort& v)
@@ -107,6 +109,13 @@ namespace View
 		al_draw_scaled_bitmap(bmp, 0, 0, sw, sh, new_tl.x, new_tl.y, sw * v.scale * scale.x, sh * v.scale * scale.y, flags);
 	}
 
+	void drawScaledBitmapRegion(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d& s_tl, const vec2d& s_dim, const vec2d& d_tl, const vec2d& d_dim, int flags)
+	{
+		vec2d new_tl = worldToScreen(d_tl, v);
+
+		al_draw_scaled_bitmap(bmp, s_tl.x, s_tl.y, s_dim.x, s_dim.y, new_tl.x, new_tl.y, d_dim.x * v.scale, d_dim.y * v.scale, flags);
+	}
+
 	void drawTintedBitmapRegion(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d s_tl, const vec2d& s_dim, const vec2d& d_tl, const ALLEGRO_COLOR& cl, int flags)
 	{
 		vec2d new_tl = worldToScreen(d_tl, v);
@@ -114,4 +123,152 @@ namespace View
 		al_draw_tinted_scaled_rotated_bitmap_region(bmp, s_tl.x, s_tl.y, s_dim.x, s_dim.y,
 			cl, 0, 0, new_tl.x, new_tl.y, v.scale, v.scale, 0, flags);
 	}
-};
\ No newline at end of file
+
+	void drawTintedScaledBitmapRegion(const ViewPort& v, ALLEGRO_BITMAP* bmp, const vec2d& s_tl, const vec2d& s_dim, const vec2d& d_tl, const vec2d& d_dim, const ALLEGRO_COLOR& cl, int flags)
+	{
+		vec2d new_tl = worldToScreen(d_tl, v);
+
+		al_draw_tinted_scaled_bitmap(bmp, cl, s_tl.x, s_tl.y, s_dim.x, s_dim.y, new_tl.x, new_tl.y, d_dim.x * v.scale, d_dim.y * v.scale, flags);
+	}
+
+	//Batched Drawing
+
+	static ALLEGRO_VERTEX makeVertex(double x, double y, const ALLEGRO_COLOR& cl)
+	{
+		return ALLEGRO_VERTEX{static_cast<float>(x), static_cast<float>(y), 0.0f, 0.0f, 0.0f, cl};
+	}
+
+	// Quad indices only depend on how many quads there are, so they are only ever appended
+	static void growQuadIndices(std::vector<int>& indices, size_t quads)
+	{
+		for (size_t q = indices.size() / 6; q < quads; ++q)
+		{
+			int i = static_cast<int>(q * 4);
+			indices.insert(indices.end(), {i, i + 1, i + 2, i, i + 2, i + 3});
+		}
+	}
+
+	// The one pass from world to screen for a whole batch
+	static void toScreen(const ViewPort& v, const std::vector<ALLEGRO_VERTEX>& world, std::vector<ALLEGRO_VERTEX>& screen)
+	{
+		const float scale = static_cast<float>(v.scale);
+		const float off_x = static_cast<float>(v.size.x / 2.0 + v.screen_pos.x - v.world_pos.x * v.scale);
+		const float off_y = static_cast<float>(v.size.y / 2.0 + v.screen_pos.y - v.world_pos.y * v.scale);
+
+		screen.resize(world.size());
+		for (size_t i = 0; i < world.size(); ++i)
+		{
+			screen[i] = world[i];
+			screen[i].x = world[i].x * scale + off_x;
+			screen[i].y = world[i].y * scale + off_y;
+		}
+	}
+
+	void clearBatch(QuadBatch& b)
+	{
+		b.count = 0;
+		b.world.clear();
+	}
+
+	void clearBatch(LineBatch& b, double line_width)
+	{
+		b.line_width = line_width;
+		b.count = 0;
+		b.world.clear();
+	}
+
+	void addQuad(QuadBatch& b, const vec2d& tl, const vec2d& br, const ALLEGRO_COLOR& cl)
+	{
+		b.world.push_back(makeVertex(tl.x, tl.y, cl));
+		b.world.push_back(makeVertex(br.x, tl.y, cl));
+		b.world.push_back(makeVertex(br.x, br.y, cl));
+		b.world.push_back(makeVertex(tl.x, br.y, cl));
+		++b.count;
+	}
+
+	void addLine(LineBatch& b, const vec2d& v1, const vec2d& v2, const ALLEGRO_COLOR& cl)
+	{
+		b.world.push_back(makeVertex(v1.x, v1.y, cl));
+		b.world.push_back(makeVertex(v2.x, v2.y, cl));
+		++b.count;
+	}
+
+	void drawBatch(const ViewPort& v, QuadBatch& b)
+	{
+		if (b.count == 0) return;
+
+		toScreen(v, b.world, b.screen);
+
+		growQuadIndices(b.indices, b.count);
+		al_draw_indexed_prim(b.screen.data(), nullptr, nullptr, b.indices.data(), static_cast<int>(b.count * 6), ALLEGRO_PRIM_TRIANGLE_LIST);
+	}
+
+	void drawBatch(const ViewPort& v, LineBatch& b)
+	{
+		if (b.count == 0) return;
+
+		const float thickness = static_cast<float>(std::max(b.line_width * v.scale, 1.0));
+
+		if (thickness <= 1.0f)
+		{
+			// Hairlines, the GPU rasterises them directly
+			toScreen(v, b.world, b.screen);
+			al_draw_prim(b.screen.data(), nullptr, nullptr, 0, static_cast<int>(b.screen.size()), ALLEGRO_PRIM_LINE_LIST);
+			return;
+		}
+
+		// Thick lines become quads, offset half the thickness either side
+		const float scale = static_cast<float>(v.scale);
+		const float off_x = static_cast<float>(v.size.x / 2.0 + v.screen_pos.x - v.world_pos.x * v.scale);
+		const float off_y = static_cast<float>(v.size.y / 2.0 + v.screen_pos.y - v.world_pos.y * v.scale);
+
+		b.screen.resize(b.count * 4);
+		for (size_t l = 0; l < b.count; ++l)
+		{
+			const ALLEGRO_VERTEX& a = b.world[l * 2];
+			const ALLEGRO_VERTEX& c = b.world[l * 2 + 1];
+
+			float ax = a.x * scale + off_x, ay = a.y * scale + off_y;
+			float cx = c.x * scale + off_x, cy = c.y * scale + off_y;
+			float dx = cx - ax, dy = cy - ay;
+			float len = static_cast<float>(sqrt(dx * dx + dy * dy));
+			float nx = len > 0.0f ? -dy / len * thickness / 2.0f : 0.0f;
+			float ny = len > 0.0f ? dx / len * thickness / 2.0f : 0.0f;
+
+			ALLEGRO_VERTEX* q = &b.screen[l * 4];
+			q[0] = a; q[0].x = ax + nx; q[0].y = ay + ny;
+			q[1] = c; q[1].x = cx + nx; q[1].y = cy + ny;
+			q[2] = c; q[2].x = cx - nx; q[2].y = cy - ny;
+			q[3] = a; q[3].x = ax - nx; q[3].y = ay - ny;
+		}
+
+		growQuadIndices(b.indices, b.count);
+		al_draw_indexed_prim(b.screen.data(), nullptr, nullptr, b.indices.data(), static_cast<int>(b.count * 6), ALLEGRO_PRIM_TRIANGLE_LIST);
+	}
+
+	void drawBatchTransformed(const ViewPort& v, LineBatch& b)
+	{
+		if (b.count == 0) return;
+
+		// A hairline can't be widened through the transform
+		if (b.line_width * v.scale > 1.0)
+		{
+			drawBatch(v, b);
+			return;
+		}
+
+		ALLEGRO_TRANSFORM old, t;
+		al_copy_transform(&old, al_get_current_transform());
+
+		// Same mapping as worldToScreen()
+		al_identity_transform(&t);
+		al_translate_transform(&t, -v.world_pos.x, -v.world_pos.y);
+		al_scale_transform(&t, v.scale, v.scale);
+		al_translate_transform(&t, v.size.x / 2.0 + v.screen_pos.x, v.size.y / 2.0 + v.screen_pos.y);
+		al_compose_transform(&t, &old);
+
+		al_use_transform(&t);
+		al_draw_prim(b.world.data(), nullptr, nullptr, 0, static_cast<int>(b.world.size()), ALLEGRO_PRIM_LINE_LIST);
+		al_use_transform(&old);
+	}
+};
@@ -0,0 +1,51 @@
+#include "visibility_history.hpp"
+
+// Bands of s that neighbour doesn't share, steps only ever share with the ones next to them
+static size_t getOwnSize(const TileSnapshot& s, const TileSnapshot* neighbour)
+{
+	bool same_size = neighbour && neighbour->blocks.size() == s.blocks.size();
+
+	size_t size = 0;
+	for (size_t b = 0; b < s.blocks.size(); ++b)
+	{
+		if (!same_size || s.blocks[b] != neighbour->blocks[b]) size += getTileSnapshotBlockSize(s, b);
+	}
+	return size;
+}
+
+void VisibilityHistory::reset(const Map& m)
+{
+	steps.clear();
+	steps.push_back({makeTileSnapshot(m, nullptr, 0), m.edit_stamp});
+	cursor = 0;
+	bytes = getOwnSize(*steps.back().tiles, nullptr);
+}
+
+void VisibilityHistory::commit(const Map& m)
+{
+	if (steps.empty()) return reset(m);
+
+	// The redo steps, newest first so each is only compared with the one it was taken after
+	while (steps.size() > cursor + 1)
+	{
+		bytes -= getOwnSize(*steps.back().tiles, steps[steps.size() - 2].tiles.get());
+		steps.pop_back();
+	}
+
+	const Step& base = steps.back();
+	std::shared_ptr<TileSnapshot> snap = makeTileSnapshot(m, base.tiles.get(), base.stamp);
+	snap->version = base.tiles->version + 1;
+
+	bytes += getOwnSize(*snap, base.tiles.get());
+	steps.push_back({std::move(snap), m.edit_stamp});
+	cursor = steps.size() - 1;
+}
+
+void VisibilityHistory::dropOldest()
+{
+	if (steps.size() < 2) return;
+
+	bytes -= getOwnSize(*steps[0].tiles, steps[1].tiles.get());
+	steps.pop_front();
+	if (cursor > 0) --cursor;
+}